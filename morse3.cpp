@@ -1,265 +1,2065 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <cmath>
+#include <complex>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <limits>
+#include <numeric>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <tuple>
+#include <type_traits>
 #include <exception>
 #include <sstream>
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define MORSE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MORSE_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+constexpr uint16_t WAVE_FORMAT_PCM = 1;
+constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+
 struct WavHeader {
     char riffId[4] = {'R', 'I', 'F', 'F'};
     uint32_t riffSize;
     char waveId[4] = {'W', 'A', 'V', 'E'};
 
-    char fmtId[4] = {'f', 'm', 't', ' '};
-    uint32_t fmtSize = 16;
-    uint16_t audioFormat = 1;
-    uint16_t numChannels = 1;
-    uint32_t sampleRate = 44100;
-    uint32_t byteRate;
-    uint16_t blockAlign;
-    uint16_t bitsPerSample = 16;
+    char fmtId[4] = {'f', 'm', 't', ' '};
+    uint32_t fmtSize = 16;
+    uint16_t audioFormat = 1;
+    uint16_t numChannels = 1;
+    uint32_t sampleRate = 44100;
+    uint32_t byteRate;
+    uint16_t blockAlign;
+    uint16_t bitsPerSample = 16;
+
+    char dataId[4] = {'d', 'a', 't', 'a'};
+    uint32_t dataSize;
+};
+
+// Exact output size of an encoding job, known before any sample is produced.
+struct AudioPlan {
+    uint64_t sampleCount = 0;
+    double durationSeconds = 0.0;
+    uint64_t fileBytes = 0;
+};
+
+class MorseException : public std::exception {
+    std::string msg;
+public:
+    explicit MorseException(std::string message) : msg(std::move(message)) {}
+    const char* what() const noexcept override { return msg.c_str(); }
+};
+
+class MorseBase {
+public:
+    virtual ~MorseBase() noexcept = default;
+    virtual std::string encode(const std::string& text) = 0;
+    virtual std::string decode(const std::string& morse) = 0;
+};
+
+struct MorseCode {
+    char symbol;
+    std::string_view code;
+};
+
+constexpr MorseCode MORSE_CODES[] = {
+    {'A', ".-"}, {'B', "-..."}, {'C', "-.-."}, {'D', "-.."}, {'E', "."},
+    {'F', "..-."}, {'G', "--."}, {'H', "...."}, {'I', ".."}, {'J', ".---"},
+    {'K', "-.-"}, {'L', ".-.."}, {'M', "--"}, {'N', "-."}, {'O', "---"},
+    {'P', ".--."}, {'Q', "--.-"}, {'R', ".-."}, {'S', "..."}, {'T', "-"},
+    {'U', "..-"}, {'V', "...-"}, {'W', ".--"}, {'X', "-..-"}, {'Y', "-.--"},
+    {'Z', "--.."}, {'0', "-----"}, {'1', ".----"}, {'2', "..---"}, {'3', "...--"},
+    {'4', "....-"}, {'5', "....."}, {'6', "-...."}, {'7', "--..."}, {'8', "---.."},
+    {'9', "----."}, {'.', ".-.-.-"}, {',', "--..--"}, {'?', "..--.."}
+};
+
+// Packs a dot/dash sequence into one byte: a leading 1 marks the length and each
+// following bit is 0 for a dot, 1 for a dash. Returns 0 for anything unpackable.
+constexpr uint8_t packMorse(std::string_view code) {
+    if (code.empty() || code.size() > 7) return 0;
+    unsigned packed = 1;
+    for (char c : code) {
+        if (c != '.' && c != '-') return 0;
+        packed = (packed << 1) | (c == '-' ? 1u : 0u);
+    }
+    return static_cast<uint8_t>(packed);
+}
+
+constexpr std::array<std::string_view, 256> makeEncodeTable() {
+    std::array<std::string_view, 256> table{};
+    for (const auto& entry : MORSE_CODES) {
+        table[static_cast<unsigned char>(entry.symbol)] = entry.code;
+        if (entry.symbol >= 'A' && entry.symbol <= 'Z') {
+            table[static_cast<unsigned char>(entry.symbol - 'A' + 'a')] = entry.code;
+        }
+    }
+    return table;
+}
+
+constexpr std::array<char, 256> makeDecodeTable() {
+    std::array<char, 256> table{};
+    for (const auto& entry : MORSE_CODES) {
+        table[packMorse(entry.code)] = entry.symbol;
+    }
+    return table;
+}
+
+class MorseConverter : public MorseBase {
+private:
+    static constexpr std::array<std::string_view, 256> charToMorse = makeEncodeTable();
+    static constexpr std::array<char, 256> morseToChar = makeDecodeTable();
+
+public:
+    // Carries separator state between chunks so a text can be encoded piecewise.
+    struct EncodeState {
+        bool started = false;
+        bool prevWasSpace = false;
+    };
+
+    // Pending token (bit-packed as in packMorse) and space run carried between
+    // decodeChunk() calls.
+    struct DecodeState {
+        unsigned packed = 1;
+        unsigned length = 0;
+        bool valid = true;
+        unsigned spaces = 0;
+    };
+
+    MorseConverter() = default;
+    ~MorseConverter() noexcept override = default;
+
+    std::string encode(const std::string& text) override {
+        std::string morse;
+        EncodeState state;
+        encodeChunk(text, state, morse);
+        return morse;
+    }
+
+    void encodeChunk(std::string_view text, EncodeState& state, std::string& morse) const {
+        for (char c : text) {
+            if (c == ' ') {
+                morse += "   ";
+                state.prevWasSpace = true;
+            } else {
+                if (state.started && !state.prevWasSpace) morse += ' ';
+                const std::string_view code = charToMorse[static_cast<unsigned char>(c)];
+                if (code.empty()) {
+                    const char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+                    throw MorseException("Character '" + std::string(1, upper) + "' cannot be encoded in Morse.");
+                }
+                morse += code;
+                state.prevWasSpace = false;
+            }
+            state.started = true;
+        }
+    }
+
+    std::string decode(const std::string& morse) override {
+        std::string text(morse.size() + 1, '\0');
+        DecodeState state;
+        size_t n = decodeChunk(morse, state, text.data());
+        n += finishDecode(state, text.data() + n);
+        text.resize(n);
+        return text;
+    }
+
+    // Single pass without allocation. Every emitted character is triggered by one
+    // input character, so `out` needs room for morse.size() characters; a token is
+    // emitted when the space ending it arrives, a word break on every third space.
+    size_t decodeChunk(std::string_view morse, DecodeState& state, char* out) const {
+        char* const begin = out;
+        for (char c : morse) {
+            if (c == ' ') {
+                if (state.length > 0) {
+                    const char decoded = takeToken(state);
+                    if (decoded != '\0') *out++ = decoded;
+                }
+                if (++state.spaces == 3) {
+                    *out++ = ' ';
+                    state.spaces = 0;
+                }
+                continue;
+            }
+            state.spaces = 0;
+            if (++state.length > 7 || (c != '.' && c != '-')) state.valid = false;
+            state.packed = ((state.packed << 1) | (c == '-' ? 1u : 0u)) & 0xFFu;
+        }
+        return static_cast<size_t>(out - begin);
+    }
+
+    // Flushes the last token; writes at most one character.
+    size_t finishDecode(DecodeState& state, char* out) const {
+        if (state.length == 0) return 0;
+        *out = takeToken(state);
+        return *out != '\0' ? 1 : 0;
+    }
+
+private:
+    static char takeToken(DecodeState& state) {
+        const char c = state.valid ? morseToChar[state.packed] : '\0';
+        state = DecodeState{};
+        return c;
+    }
+};
+
+// Packed little-endian 24-bit PCM sample.
+struct Int24 {
+    uint8_t bytes[3];
+};
+
+// Per-format constants and conversions. Level is the type magnitudes and
+// detection thresholds are compared in; fromUnit maps [-1, 1] to the format.
+template<typename SampleType>
+struct SampleTraits {
+    using Level = std::conditional_t<(sizeof(SampleType) <= 2), int, int64_t>;
+    static constexpr Level MAX_LEVEL = std::numeric_limits<SampleType>::max();
+
+    static Level level(SampleType s) { return s < 0 ? -static_cast<Level>(s) : static_cast<Level>(s); }
+    static Level value(SampleType s) { return s; }
+    static SampleType fromValue(Level v) { return static_cast<SampleType>(v); }
+    static SampleType fromUnit(double x) { return static_cast<SampleType>(MAX_LEVEL * x); }
+    static SampleType silence() { return SampleType{}; }
+};
+
+// WAV 8-bit PCM is unsigned around a bias of 128. Magnitudes come from a
+// table instead of a subtract/abs per sample.
+template<>
+struct SampleTraits<uint8_t> {
+    using Level = int;
+    static constexpr Level MAX_LEVEL = 127;
+    static constexpr uint8_t BIAS = 128;
+
+    static constexpr std::array<uint8_t, 256> LEVELS = [] {
+        std::array<uint8_t, 256> table{};
+        for (int b = 0; b < 256; ++b) table[b] = static_cast<uint8_t>(b < BIAS ? BIAS - b : b - BIAS);
+        return table;
+    }();
+
+    static Level level(uint8_t s) { return LEVELS[s]; }
+    static Level value(uint8_t s) { return s - BIAS; }
+    static uint8_t fromValue(Level v) { return static_cast<uint8_t>(v + BIAS); }
+    static uint8_t fromUnit(double x) { return static_cast<uint8_t>(BIAS + static_cast<int>(MAX_LEVEL * x)); }
+    static uint8_t silence() { return BIAS; }
+};
+
+template<>
+struct SampleTraits<Int24> {
+    using Level = int32_t;
+    static constexpr Level MAX_LEVEL = 8388607;
+
+    static Level value(Int24 s) {
+        const uint32_t raw = s.bytes[0] | (s.bytes[1] << 8) | (static_cast<uint32_t>(s.bytes[2]) << 16);
+        return static_cast<int32_t>(raw << 8) >> 8;
+    }
+    static Level level(Int24 s) { return std::abs(value(s)); }
+    static Int24 fromValue(Level v) {
+        return {{static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v >> 16)}};
+    }
+    static Int24 fromUnit(double x) { return fromValue(static_cast<int32_t>(MAX_LEVEL * x)); }
+    static Int24 silence() { return Int24{}; }
+};
+
+template<>
+struct SampleTraits<float> {
+    using Level = float;
+    static constexpr Level MAX_LEVEL = 1.0f;
+
+    static Level level(float s) { return std::fabs(s); }
+    static Level value(float s) { return s; }
+    static float fromValue(Level v) { return v; }
+    static float fromUnit(double x) { return static_cast<float>(x); }
+    static float silence() { return 0.0f; }
+};
+
+// Counts what a generator would emit without storing anything.
+class CountingSink {
+    uint64_t samples = 0;
+public:
+    template<typename SampleType>
+    void append(const SampleType*, size_t n) { samples += n; }
+    void appendSilence(size_t n) { samples += n; }
+    uint64_t count() const { return samples; }
+};
+
+// A maximal stretch of samples that are all above (tone) or all below the threshold.
+struct ToneRun {
+    bool tone;
+    uint64_t length;
+};
+
+inline unsigned countTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+    unsigned n = 0;
+    while (!(bits & 1)) { bits >>= 1; ++n; }
+    return n;
+#endif
+}
+
+// Builds 64-sample tone masks (bit k set when |samples[k]| > threshold) and turns
+// them into runs. The mask kernel is picked once at runtime: AVX2 or SSE2 for
+// 8/16-bit samples on x86, a scalar loop everywhere else. Unsigned 8-bit samples
+// reuse the signed kernels after flipping the bias bit (b ^ 0x80 == b - 128).
+template<typename SampleType>
+class EnvelopeScanner {
+    using Traits = SampleTraits<SampleType>;
+    using Level = typename Traits::Level;
+    using MaskFn = uint64_t (*)(const SampleType*, Level);
+
+    static uint64_t scalarMask(const SampleType* s, Level threshold) {
+        uint64_t bits = 0;
+        for (unsigned k = 0; k < 64; ++k) {
+            bits |= static_cast<uint64_t>(Traits::level(s[k]) > threshold) << k;
+        }
+        return bits;
+    }
+
+#ifdef MORSE_X86_SIMD
+    static uint64_t sse2Mask(const SampleType* s, Level threshold);
+    __attribute__((target("avx2"))) static uint64_t avx2Mask(const SampleType* s, Level threshold);
+#endif
+
+    static MaskFn selectMask() {
+#ifdef MORSE_X86_SIMD
+        if constexpr (std::is_same_v<SampleType, int8_t> || std::is_same_v<SampleType, uint8_t> ||
+                      std::is_same_v<SampleType, int16_t>) {
+            return __builtin_cpu_supports("avx2") ? &avx2Mask : &sse2Mask;
+        }
+#endif
+        return &scalarMask;
+    }
+
+    static void pushRun(bool tone, uint64_t length, std::vector<ToneRun>& runs) {
+        if (!runs.empty() && runs.back().tone == tone) {
+            runs.back().length += length;
+        } else {
+            runs.push_back({tone, length});
+        }
+    }
+
+    static void appendMask(uint64_t mask, unsigned count, std::vector<ToneRun>& runs) {
+        unsigned pos = 0;
+        while (pos < count) {
+            const uint64_t rest = mask >> pos;
+            const bool tone = rest & 1;
+            const uint64_t changes = tone ? ~rest : rest;
+            const unsigned length = std::min(changes ? countTrailingZeros(changes) : 64 - pos, count - pos);
+            pushRun(tone, length, runs);
+            pos += length;
+        }
+    }
+
+public:
+    static void scan(const SampleType* samples, size_t n, Level threshold, std::vector<ToneRun>& runs) {
+        static const MaskFn mask = selectMask();
+
+        size_t i = 0;
+        for (; i + 64 <= n; i += 64) {
+            appendMask(mask(samples + i, threshold), 64, runs);
+        }
+        for (; i < n; ++i) {
+            pushRun(Traits::level(samples[i]) > threshold, 1, runs);
+        }
+    }
+};
+
+#ifdef MORSE_X86_SIMD
+template<>
+inline uint64_t EnvelopeScanner<int8_t>::sse2Mask(const int8_t* s, int threshold) {
+    const __m128i hi = _mm_set1_epi8(static_cast<char>(threshold));
+    const __m128i lo = _mm_set1_epi8(static_cast<char>(-threshold));
+    uint64_t bits = 0;
+    for (unsigned k = 0; k < 4; ++k) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16 * k));
+        const __m128i above = _mm_or_si128(_mm_cmpgt_epi8(x, hi), _mm_cmplt_epi8(x, lo));
+        bits |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(above))) << (16 * k);
+    }
+    return bits;
+}
+
+template<>
+__attribute__((target("avx2"))) inline uint64_t EnvelopeScanner<int8_t>::avx2Mask(const int8_t* s, int threshold) {
+    const __m256i hi = _mm256_set1_epi8(static_cast<char>(threshold));
+    const __m256i lo = _mm256_set1_epi8(static_cast<char>(-threshold));
+    uint64_t bits = 0;
+    for (unsigned k = 0; k < 2; ++k) {
+        const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 32 * k));
+        const __m256i above = _mm256_or_si256(_mm256_cmpgt_epi8(x, hi), _mm256_cmpgt_epi8(lo, x));
+        bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(above))) << (32 * k);
+    }
+    return bits;
+}
+
+template<>
+inline uint64_t EnvelopeScanner<uint8_t>::sse2Mask(const uint8_t* s, int threshold) {
+    const __m128i hi = _mm_set1_epi8(static_cast<char>(threshold));
+    const __m128i lo = _mm_set1_epi8(static_cast<char>(-threshold));
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    uint64_t bits = 0;
+    for (unsigned k = 0; k < 4; ++k) {
+        const __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16 * k)), bias);
+        const __m128i above = _mm_or_si128(_mm_cmpgt_epi8(x, hi), _mm_cmplt_epi8(x, lo));
+        bits |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(above))) << (16 * k);
+    }
+    return bits;
+}
+
+template<>
+__attribute__((target("avx2"))) inline uint64_t EnvelopeScanner<uint8_t>::avx2Mask(const uint8_t* s, int threshold) {
+    const __m256i hi = _mm256_set1_epi8(static_cast<char>(threshold));
+    const __m256i lo = _mm256_set1_epi8(static_cast<char>(-threshold));
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+    uint64_t bits = 0;
+    for (unsigned k = 0; k < 2; ++k) {
+        const __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 32 * k)), bias);
+        const __m256i above = _mm256_or_si256(_mm256_cmpgt_epi8(x, hi), _mm256_cmpgt_epi8(lo, x));
+        bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(above))) << (32 * k);
+    }
+    return bits;
+}
+
+template<>
+inline uint64_t EnvelopeScanner<int16_t>::sse2Mask(const int16_t* s, int threshold) {
+    const __m128i hi = _mm_set1_epi16(static_cast<short>(threshold));
+    const __m128i lo = _mm_set1_epi16(static_cast<short>(-threshold));
+    uint64_t bits = 0;
+    for (unsigned k = 0; k < 4; ++k) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16 * k));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16 * k + 8));
+        const __m128i aboveA = _mm_or_si128(_mm_cmpgt_epi16(a, hi), _mm_cmplt_epi16(a, lo));
+        const __m128i aboveB = _mm_or_si128(_mm_cmpgt_epi16(b, hi), _mm_cmplt_epi16(b, lo));
+        const __m128i packed = _mm_packs_epi16(aboveA, aboveB);
+        bits |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(packed))) << (16 * k);
+    }
+    return bits;
+}
+
+template<>
+__attribute__((target("avx2"))) inline uint64_t EnvelopeScanner<int16_t>::avx2Mask(const int16_t* s, int threshold) {
+    const __m256i hi = _mm256_set1_epi16(static_cast<short>(threshold));
+    const __m256i lo = _mm256_set1_epi16(static_cast<short>(-threshold));
+    uint64_t bits = 0;
+    for (unsigned k = 0; k < 2; ++k) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 32 * k));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 32 * k + 16));
+        const __m256i aboveA = _mm256_or_si256(_mm256_cmpgt_epi16(a, hi), _mm256_cmpgt_epi16(lo, a));
+        const __m256i aboveB = _mm256_or_si256(_mm256_cmpgt_epi16(b, hi), _mm256_cmpgt_epi16(lo, b));
+        // packs works per 128-bit lane; restore sample order before the movemask.
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(aboveA, aboveB), 0xD8);
+        bits |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(packed))) << (32 * k);
+    }
+    return bits;
+}
+#endif
+
+// How the decoder separates tone from silence.
+enum class ToneDetection { Envelope, Goertzel };
+
+// Narrowband alternative to EnvelopeScanner for off-air audio. The carrier's
+// amplitude is measured per Hann-windowed block of whole carrier periods (about
+// 10 ms) with the Goertzel recurrence, so hum and noise outside the carrier's
+// band barely register. A block is tone when its amplitude exceeds the envelope
+// threshold, half the recent peak (which decays with a 2 s half-life) and four
+// times the average amplitude of recent silent blocks. That average is seeded
+// from the first NOISE_SEED_SECONDS of blocks, which are held back until they
+// are complete however the input is chunked, so the result depends neither on
+// the block sizes fed in nor on the thread count. Blocks are measured eight at a
+// time, one per SIMD lane, and split across threads; only the cheap
+// classification pass is sequential.
+template<typename SampleType>
+class GoertzelScanner {
+    using Traits = SampleTraits<SampleType>;
+    static constexpr size_t LANES = 8;
+    static constexpr size_t MIN_PARALLEL_SAMPLES = 256 * 1024;
+    static constexpr double BLOCK_SECONDS = 0.01;
+    static constexpr double PEAK_HALF_LIFE = 2.0;
+    static constexpr float PEAK_RATIO = 0.5f;
+    static constexpr float NOISE_RATIO = 4.0f;
+    static constexpr float NOISE_SMOOTHING = 0.05f;
+    static constexpr double NOISE_SEED_SECONDS = 2.0;
+
+    size_t blockSize;
+    float coeff;
+    float floorAmplitude;
+    size_t seedBlocks;
+    float decay;
+    std::vector<float> window;
+    float gain;
+    float peak = 0.0f;
+    float noise = -1.0f;
+    std::vector<SampleType> carry;
+    std::vector<float> amplitudes;
+    std::vector<float> seed;  // amplitudes held back until the noise average is seeded
+
+    // power[l] for the lane-interleaved blocks in data (data[i * LANES + l]).
+    void goertzel(const float* data, float* power) const {
+#ifdef MORSE_X86_SIMD
+        const __m128 c = _mm_set1_ps(coeff);
+        __m128 a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), b1 = _mm_setzero_ps(), b2 = _mm_setzero_ps();
+        for (size_t i = 0; i < blockSize; ++i) {
+            const __m128 a = _mm_add_ps(_mm_loadu_ps(data + i * LANES), _mm_sub_ps(_mm_mul_ps(c, a1), a2));
+            const __m128 b = _mm_add_ps(_mm_loadu_ps(data + i * LANES + 4), _mm_sub_ps(_mm_mul_ps(c, b1), b2));
+            a2 = a1;
+            a1 = a;
+            b2 = b1;
+            b1 = b;
+        }
+        const auto finish = [c](__m128 s1, __m128 s2) {
+            return _mm_sub_ps(_mm_add_ps(_mm_mul_ps(s1, s1), _mm_mul_ps(s2, s2)), _mm_mul_ps(c, _mm_mul_ps(s1, s2)));
+        };
+        _mm_storeu_ps(power, finish(a1, a2));
+        _mm_storeu_ps(power + 4, finish(b1, b2));
+#else
+        float s1[LANES] = {}, s2[LANES] = {};
+        for (size_t i = 0; i < blockSize; ++i) {
+            for (size_t l = 0; l < LANES; ++l) {
+                const float s = data[i * LANES + l] + coeff * s1[l] - s2[l];
+                s2[l] = s1[l];
+                s1[l] = s;
+            }
+        }
+        for (size_t l = 0; l < LANES; ++l) power[l] = s1[l] * s1[l] + s2[l] * s2[l] - coeff * s1[l] * s2[l];
+#endif
+    }
+
+    void measure(const SampleType* samples, size_t blocks, float* out) const {
+        std::vector<float> interleaved(LANES * blockSize);
+        float power[LANES];
+        for (size_t b = 0; b < blocks; b += LANES) {
+            const size_t lanes = std::min(LANES, blocks - b);
+            for (size_t l = 0; l < LANES; ++l) {
+                const SampleType* block = samples + (b + l) * blockSize;
+                for (size_t i = 0; i < blockSize; ++i) {
+                    interleaved[i * LANES + l] = l < lanes ? window[i] * static_cast<float>(Traits::value(block[i])) : 0.0f;
+                }
+            }
+            goertzel(interleaved.data(), power);
+            for (size_t l = 0; l < lanes; ++l) out[b + l] = gain * std::sqrt(std::max(0.0f, power[l]));
+        }
+    }
+
+    // Seeds the noise average from the held-back blocks and classifies them: their
+    // lower quartile is silence unless the signal is keyed more than 75% of the
+    // time, and for noise-only blocks the mean amplitude is about 1.65 times that
+    // quartile.
+    void seedNoise(std::vector<ToneRun>& runs) {
+        std::vector<float> sorted(seed);
+        const auto quartile = sorted.begin() + static_cast<std::ptrdiff_t>(sorted.size() / 4);
+        std::nth_element(sorted.begin(), quartile, sorted.end());
+        noise = 1.65f * *quartile;
+        for (const float amplitude : seed) classify(amplitude, runs);
+        seed.clear();
+    }
+
+    void classify(float amplitude, std::vector<ToneRun>& runs) {
+        peak = std::max(amplitude, peak * decay);
+        const bool tone = amplitude > floorAmplitude && amplitude > peak * PEAK_RATIO && amplitude > noise * NOISE_RATIO;
+        if (!tone) noise += NOISE_SMOOTHING * (amplitude - noise);
+        if (!runs.empty() && runs.back().tone == tone) {
+            runs.back().length += blockSize;
+        } else {
+            runs.push_back({tone, blockSize});
+        }
+    }
+
+public:
+    GoertzelScanner(uint32_t sampleRate, double frequency)
+        : blockSize(std::max<size_t>(1, static_cast<size_t>(std::lround(
+              std::max(1.0, std::round(BLOCK_SECONDS * frequency)) * sampleRate / frequency)))),
+          coeff(static_cast<float>(2 * std::cos(2 * M_PI * frequency / sampleRate))),
+          floorAmplitude(static_cast<float>(Traits::MAX_LEVEL) / 100),
+          seedBlocks(std::max<size_t>(1, static_cast<size_t>(std::lround(NOISE_SEED_SECONDS * sampleRate / blockSize)))),
+          decay(static_cast<float>(std::pow(0.5, blockSize / (sampleRate * PEAK_HALF_LIFE)))),
+          window(blockSize) {
+        double sum = 0.0;
+        for (size_t i = 0; i < blockSize; ++i) {
+            window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2 * M_PI * (i + 0.5) / blockSize));
+            sum += window[i];
+        }
+        // A carrier of amplitude A then measures A.
+        gain = static_cast<float>(2.0 / sum);
+    }
+
+    // Appends the runs of every block completed by these samples; a trailing
+    // partial block is kept for the next call. Until the noise average is seeded
+    // no runs are produced; finish() releases them for inputs shorter than that.
+    void scan(const SampleType* samples, size_t n, std::vector<ToneRun>& runs, unsigned threads = 1) {
+        size_t used = 0;
+        const size_t first = carry.empty() ? 0 : 1;
+        if (first) {
+            used = std::min(blockSize - carry.size(), n);
+            carry.insert(carry.end(), samples, samples + used);
+            if (carry.size() < blockSize) return;
+        }
+
+        const size_t blocks = (n - used) / blockSize;
+        amplitudes.resize(first + blocks);
+        if (first) {
+            measure(carry.data(), 1, amplitudes.data());
+            carry.clear();
+        }
+        if (threads <= 1 || blocks * blockSize < threads * MIN_PARALLEL_SAMPLES) {
+            measure(samples + used, blocks, amplitudes.data() + first);
+        } else {
+            const size_t chunk = (blocks / threads + LANES - 1) / LANES * LANES;
+            std::vector<std::thread> workers;
+            for (size_t begin = 0; begin < blocks; begin += chunk) {
+                workers.emplace_back([this, samples, used, first, begin, count = std::min(chunk, blocks - begin)] {
+                    measure(samples + used + begin * blockSize, count, amplitudes.data() + first + begin);
+                });
+            }
+            for (auto& worker : workers) worker.join();
+        }
+        carry.assign(samples + used + blocks * blockSize, samples + n);
+
+        size_t next = 0;
+        if (noise < 0.0f) {
+            next = std::min(amplitudes.size(), seedBlocks - seed.size());
+            seed.insert(seed.end(), amplitudes.begin(), amplitudes.begin() + static_cast<std::ptrdiff_t>(next));
+            if (seed.size() < seedBlocks) return;
+            seedNoise(runs);
+        }
+        for (; next < amplitudes.size(); ++next) classify(amplitudes[next], runs);
+    }
+
+    // Appends the runs of blocks still held back for seeding; call after the last scan().
+    void finish(std::vector<ToneRun>& runs) {
+        if (!seed.empty()) seedNoise(runs);
+    }
+};
+
+// Power spectrum of a real block of power-of-two length. The block is packed
+// into a complex FFT of half the length (even samples real, odd imaginary) and
+// the two interleaved spectra are separated afterwards.
+class RealFft {
+    size_t size;
+    std::vector<std::complex<float>> twiddles;  // e^(-2 pi i k / size), k < size / 2
+    std::vector<size_t> reversed;
+    std::vector<std::complex<float>> work;
+
+public:
+    explicit RealFft(size_t length) : size(length), twiddles(length / 2), reversed(length / 2), work(length / 2) {
+        for (size_t k = 0; k < size / 2; ++k) twiddles[k] = std::polar(1.0f, static_cast<float>(-2 * M_PI * k / size));
+        const size_t half = size / 2;
+        for (size_t i = 0, j = 0; i < half; ++i) {
+            reversed[i] = j;
+            size_t bit = half >> 1;
+            for (; bit && (j & bit); bit >>= 1) j ^= bit;
+            j |= bit;
+        }
+    }
+
+    size_t length() const { return size; }
+
+    // out receives size / 2 + 1 bins of |X[k]|^2.
+    void power(const float* in, float* out) {
+        const size_t half = size / 2;
+        for (size_t i = 0; i < half; ++i) work[reversed[i]] = {in[2 * i], in[2 * i + 1]};
+        for (size_t span = 1; span < half; span *= 2) {
+            const size_t stride = half / span;  // twiddle step in units of the full-size table
+            for (size_t start = 0; start < half; start += 2 * span) {
+                for (size_t k = 0; k < span; ++k) {
+                    const std::complex<float> t = twiddles[k * stride] * work[start + k + span];
+                    work[start + k + span] = work[start + k] - t;
+                    work[start + k] += t;
+                }
+            }
+        }
+        for (size_t k = 0; k <= half; ++k) {
+            const std::complex<float> a = work[k % half];
+            const std::complex<float> b = std::conj(work[(half - k) % half]);
+            const std::complex<float> even = 0.5f * (a + b);
+            const std::complex<float> odd = std::complex<float>(0.0f, -0.5f) * (a - b);
+            const std::complex<float> w = k < half ? twiddles[k] : std::complex<float>(-1.0f, 0.0f);
+            out[k] = std::norm(even + w * odd);
+        }
+    }
+};
+
+// Finds the dominant carriers of a recording from the averaged power spectrum
+// of a few Hann-windowed segments spread over it, instead of a full-file pass.
+// Segments are about 100 ms, so bins are about 10 Hz wide; peaks are refined by
+// parabolic interpolation.
+class CarrierSearch {
+    uint32_t sr;
+    RealFft fft;
+    std::vector<float> window;
+    std::vector<float> windowed;
+    std::vector<float> bins;
+    std::vector<double> spectrum;
+
+public:
+    static constexpr size_t SEGMENTS = 64;
+    static constexpr double MIN_FREQUENCY = 100.0;
+    static constexpr double MAX_FRACTION = 0.45;     // of the sample rate
+    static constexpr double MIN_PROMINENCE = 100.0;  // peak power over the median bin
+    static constexpr double MAX_DYNAMIC_RANGE = 1000.0;  // strongest peak over the weakest reported
+    static constexpr double LOCAL_PROMINENCE = 10.0;     // peak power over its higher valley
+    static constexpr double MIN_SEPARATION = 50.0;   // Hz between reported carriers
+
+    explicit CarrierSearch(uint32_t sampleRate) : sr(sampleRate), fft([sampleRate] {
+            size_t n = 256;
+            while (n < sampleRate / 10) n *= 2;
+            return n;
+        }()) {
+        const size_t n = fft.length();
+        window.resize(n);
+        for (size_t i = 0; i < n; ++i) window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2 * M_PI * i / n));
+        windowed.resize(n);
+        bins.resize(n / 2 + 1);
+        spectrum.assign(n / 2 + 1, 0.0);
+    }
+
+    size_t segmentLength() const { return fft.length(); }
+
+    void add(const float* segment) {
+        for (size_t i = 0; i < windowed.size(); ++i) windowed[i] = window[i] * segment[i];
+        fft.power(windowed.data(), bins.data());
+        for (size_t k = 0; k < bins.size(); ++k) spectrum[k] += bins[k];
+    }
+
+    // Strongest first; empty when nothing stands out from the noise floor.
+    std::vector<double> carriers(size_t maxCount) const {
+        const double binHz = static_cast<double>(sr) / fft.length();
+        const size_t low = std::max<size_t>(1, static_cast<size_t>(std::ceil(MIN_FREQUENCY / binHz)));
+        const size_t high = std::min(spectrum.size() - 2, static_cast<size_t>(MAX_FRACTION * sr / binHz));
+        if (low >= high) return {};
+
+        std::vector<double> band(spectrum.begin() + static_cast<std::ptrdiff_t>(low), spectrum.begin() + static_cast<std::ptrdiff_t>(high));
+        std::nth_element(band.begin(), band.begin() + static_cast<std::ptrdiff_t>(band.size() / 2), band.end());
+        const double floor = band[band.size() / 2];
+
+        // A peak must also stand out from the lower of its two valleys within
+        // MIN_SEPARATION, which rejects ripples on a stronger carrier's skirt.
+        const auto valley = [&](size_t k, int direction) {
+            double lowest = spectrum[k];
+            const auto reach = static_cast<ptrdiff_t>(std::ceil(MIN_SEPARATION / binHz));
+            for (ptrdiff_t d = 1; d <= reach; ++d) {
+                const ptrdiff_t j = static_cast<ptrdiff_t>(k) + direction * d;
+                if (j < 0 || j >= static_cast<ptrdiff_t>(spectrum.size()) || spectrum[j] > spectrum[k]) break;
+                lowest = std::min(lowest, spectrum[j]);
+            }
+            return lowest;
+        };
+
+        std::vector<std::pair<double, double>> peaks;  // (power, frequency)
+        for (size_t k = low; k < high; ++k) {
+            const double p = spectrum[k];
+            if (p > spectrum[k - 1] && p >= spectrum[k + 1] && p > MIN_PROMINENCE * floor &&
+                p > LOCAL_PROMINENCE * std::max(valley(k, -1), valley(k, 1))) {
+                const double a = spectrum[k - 1], c = spectrum[k + 1];
+                const double denominator = a - 2 * p + c;
+                const double offset = denominator != 0.0 ? 0.5 * (a - c) / denominator : 0.0;
+                peaks.emplace_back(p, (k + offset) * binHz);
+            }
+        }
+        std::sort(peaks.begin(), peaks.end(), [](const auto& x, const auto& y) { return x.first > y.first; });
+
+        std::vector<double> found;
+        for (const auto& [power, frequency] : peaks) {
+            // Keying sidebands and quantization products sit 40 dB or more below the carrier.
+            if (found.size() == maxCount || power * MAX_DYNAMIC_RANGE < peaks.front().first) break;
+            if (std::none_of(found.begin(), found.end(), [f = frequency](double g) { return std::abs(f - g) < MIN_SEPARATION; })) {
+                found.push_back(frequency);
+            }
+        }
+        return found;
+    }
+};
+
+// Writes through a raw cursor into memory owned by someone else; the caller
+// guarantees room for everything the generator will emit.
+template<typename SampleType>
+class PointerSink {
+    SampleType* cursor;
+public:
+    explicit PointerSink(SampleType* out) : cursor(out) {}
+
+    void append(const SampleType* data, size_t n) {
+        std::memcpy(cursor, data, n * sizeof(SampleType));
+        cursor += n;
+    }
+    void appendSilence(size_t n) {
+        std::fill_n(cursor, n, SampleTraits<SampleType>::silence());
+        cursor += n;
+    }
+};
+
+// Turns interleaved frames into one mono stream: a single channel or the average
+// of all channels. 16-bit stereo, the common receiver format, averages eight
+// frames per step with SSE2 pair sums; other layouts use a plain loop.
+template<typename SampleType>
+class ChannelMixer {
+    using Traits = SampleTraits<SampleType>;
+
+    static size_t mixStereo(const SampleType*, size_t, SampleType*) { return 0; }
+
+public:
+    static void extract(const SampleType* in, size_t frames, unsigned channels, unsigned channel, SampleType* out) {
+        for (size_t f = 0; f < frames; ++f) out[f] = in[f * channels + channel];
+    }
+
+    static void mixdown(const SampleType* in, size_t frames, unsigned channels, SampleType* out) {
+        const size_t done = (channels == 2) ? mixStereo(in, frames, out) : 0;
+        for (size_t f = done; f < frames; ++f) {
+            typename Traits::Level sum = 0;
+            for (unsigned c = 0; c < channels; ++c) sum += Traits::value(in[f * channels + c]);
+            out[f] = Traits::fromValue(sum / static_cast<typename Traits::Level>(channels));
+        }
+    }
+};
+
+#ifdef MORSE_X86_SIMD
+// Returns how many frames were mixed; the caller finishes the tail.
+template<>
+inline size_t ChannelMixer<int16_t>::mixStereo(const int16_t* in, size_t frames, int16_t* out) {
+    const __m128i ones = _mm_set1_epi16(1);
+    size_t f = 0;
+    for (; f + 8 <= frames; f += 8) {
+        __m128i a = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * f)), ones);
+        __m128i b = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * f + 8)), ones);
+        // Halve rounding toward zero, like the scalar division.
+        a = _mm_srai_epi32(_mm_add_epi32(a, _mm_srli_epi32(a, 31)), 1);
+        b = _mm_srai_epi32(_mm_add_epi32(b, _mm_srli_epi32(b, 31)), 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + f), _mm_packs_epi32(a, b));
+    }
+    return f;
+}
+#endif
+
+// Low-pass filters a stream and keeps every factor-th sample, so high-rate input
+// is detected at a lower working rate. Only the kept outputs are computed (the
+// polyphase form of FIR decimation) and the filter history carries across
+// blocks. The factor divides the input rate, so the working rate is exact.
+template<typename SampleType>
+class Decimator {
+    using Traits = SampleTraits<SampleType>;
+    static constexpr size_t TAPS_PER_PHASE = 16;
+    static constexpr size_t MIN_PARALLEL_OUTPUTS = 64 * 1024;
+
+    uint32_t factor = 1;
+    std::vector<float> taps;    // time-reversed, a multiple of 4 long
+    std::vector<float> buffer;  // filter history followed by the current block
+    size_t next = 0;            // buffer index of the newest input of the next output
+
+    static float dot(const float* a, const float* b, size_t n) {
+#ifdef MORSE_X86_SIMD
+        __m128 acc = _mm_setzero_ps();
+        for (size_t j = 0; j < n; j += 4) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + j), _mm_loadu_ps(b + j)));
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        return _mm_cvtss_f32(_mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1)));
+#else
+        float sum = 0.0f;
+        for (size_t j = 0; j < n; ++j) sum += a[j] * b[j];
+        return sum;
+#endif
+    }
+
+    static SampleType toSample(float y) {
+        if constexpr (std::is_floating_point_v<typename Traits::Level>) {
+            return Traits::fromValue(y);
+        } else {
+            const double limit = static_cast<double>(Traits::MAX_LEVEL);
+            return Traits::fromValue(static_cast<typename Traits::Level>(std::lround(std::clamp<double>(y, -limit, limit))));
+        }
+    }
+
+public:
+    // Picks the largest factor that divides inputRate and keeps the working rate
+    // at or above targetRate; a factor of 1 leaves the stream untouched.
+    Decimator(uint32_t inputRate, uint32_t targetRate) {
+        for (uint32_t f = targetRate ? inputRate / targetRate : 1; f > 1; --f) {
+            if (inputRate % f == 0) {
+                factor = f;
+                break;
+            }
+        }
+        if (factor == 1) return;
+
+        // Blackman-windowed sinc with its cutoff at 45% of the working rate.
+        const size_t length = TAPS_PER_PHASE * factor;
+        const double cutoff = 0.45 / factor;
+        taps.resize(length);
+        double sum = 0.0;
+        for (size_t j = 0; j < length; ++j) {
+            const double t = j - (length - 1) / 2.0;
+            const double sinc = t == 0.0 ? 2 * cutoff : std::sin(2 * M_PI * cutoff * t) / (M_PI * t);
+            const double window = 0.42 - 0.5 * std::cos(2 * M_PI * j / (length - 1)) + 0.08 * std::cos(4 * M_PI * j / (length - 1));
+            taps[j] = static_cast<float>(sinc * window);
+            sum += taps[j];
+        }
+        for (auto& tap : taps) tap = static_cast<float>(tap / sum);
+        std::reverse(taps.begin(), taps.end());
+        buffer.assign(length - 1, 0.0f);
+        next = length - 1;
+    }
+
+    bool active() const { return factor > 1; }
+    uint32_t outputRate(uint32_t inputRate) const { return inputRate / factor; }
+
+    // Replaces out with the decimated block. Output ranges are independent once
+    // the block is in the buffer, so large blocks are split across threads.
+    void process(const SampleType* in, size_t n, std::vector<SampleType>& out, unsigned threads = 1) {
+        const size_t history = taps.size() - 1;
+        const size_t base = buffer.size();
+        buffer.resize(base + n);
+        for (size_t i = 0; i < n; ++i) buffer[base + i] = static_cast<float>(Traits::value(in[i]));
+
+        const size_t count = next < buffer.size() ? (buffer.size() - next + factor - 1) / factor : 0;
+        out.resize(count);
+        const auto run = [this, &out, history](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                out[k] = toSample(dot(taps.data(), buffer.data() + next + k * factor - history, taps.size()));
+            }
+        };
+        if (threads <= 1 || count < threads * MIN_PARALLEL_OUTPUTS) {
+            run(0, count);
+        } else {
+            const size_t chunk = (count + threads - 1) / threads;
+            std::vector<std::thread> workers;
+            for (size_t begin = 0; begin < count; begin += chunk) workers.emplace_back(run, begin, std::min(count, begin + chunk));
+            for (auto& worker : workers) worker.join();
+        }
+
+        next += count * factor;
+        const size_t drop = buffer.size() - history;
+        buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(drop));
+        next -= drop;
+    }
+};
+
+// Format fields and data chunk location found by RiffParser.
+struct WavInfo {
+    uint16_t audioFormat = 0;
+    uint16_t numChannels = 0;
+    uint32_t sampleRate = 0;
+    uint16_t blockAlign = 0;
+    uint16_t bitsPerSample = 0;
+    uint64_t dataOffset = 0;
+    uint64_t dataSize = 0;
+    std::vector<std::string> warnings;  // header repairs the reader should report
+
+    void reportWarnings() const {
+        for (const auto& warning : warnings) std::cerr << "Warning: " << warning << std::endl;
+    }
+};
+
+// Walks the RIFF chunk list instead of assuming a fixed 44-byte header, so files
+// with LIST/fact/extended fmt chunks are read directly. Only chunk headers and the
+// fmt payload are read; everything else is skipped by offset. readAt(offset, dst, n)
+// must copy n bytes at offset and return false if it cannot.
+class RiffParser {
+    static constexpr uint16_t FORMAT_EXTENSIBLE = 0xFFFE;
+    static constexpr uint32_t STREAMING_SIZE = 0xFFFFFFFF;
+
+    static uint16_t u16(const unsigned char* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    static uint32_t u32(const unsigned char* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+public:
+    template<typename ReadAt>
+    static WavInfo parse(ReadAt&& readAt, uint64_t fileSize, const std::string& filename) {
+        unsigned char riff[12];
+        if (!readAt(0, riff, sizeof(riff)) || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+            throw MorseException("Not a RIFF/WAVE file: " + filename);
+        }
+        // Recorders that were interrupted often leave a placeholder RIFF size (36,
+        // or 0), so chunks are walked up to the end of the file; the RIFF size is
+        // only checked against where the chunks turn out to be.
+        const uint64_t end = fileSize;
+        const uint64_t riffEnd = 8 + static_cast<uint64_t>(u32(riff + 4));
+
+        WavInfo info;
+        bool haveFormat = false, haveData = false;
+        for (uint64_t offset = 12; offset + 8 <= end && !(haveFormat && haveData);) {
+            unsigned char chunk[8];
+            if (!readAt(offset, chunk, sizeof(chunk))) break;
+            const uint64_t size = u32(chunk + 4);
+            const uint64_t payload = offset + 8;
+
+            if (std::memcmp(chunk, "fmt ", 4) == 0) {
+                unsigned char fmt[40] = {};
+                if (size < 16 || payload + size > end || !readAt(payload, fmt, std::min<uint64_t>(size, sizeof(fmt)))) {
+                    throw MorseException("Malformed fmt chunk in " + filename);
+                }
+                info.audioFormat = u16(fmt);
+                info.numChannels = u16(fmt + 2);
+                info.sampleRate = u32(fmt + 4);
+                info.blockAlign = u16(fmt + 12);
+                info.bitsPerSample = u16(fmt + 14);
+                if (info.audioFormat == FORMAT_EXTENSIBLE && size >= 40) {
+                    info.audioFormat = u16(fmt + 24);  // first two bytes of the SubFormat GUID
+                }
+                haveFormat = true;
+            } else if (std::memcmp(chunk, "data", 4) == 0) {
+                info.dataOffset = payload;
+                info.dataSize = size;
+                if (size == 0 || size == STREAMING_SIZE) {
+                    // Placeholder from a recorder that never finalised the header.
+                    info.dataSize = end - payload;
+                    if (info.dataSize > 0) {
+                        info.warnings.push_back(filename + ": data chunk size not set; reading " +
+                                                std::to_string(info.dataSize) + " bytes to the end of the file");
+                    }
+                } else if (payload + size > end) {
+                    info.dataSize = end - payload;
+                    info.warnings.push_back(filename + ": data chunk claims " + std::to_string(size) + " bytes but only " +
+                                            std::to_string(info.dataSize) + " remain; the recording is truncated");
+                }
+                haveData = true;
+            } else if (payload + size > end) {
+                throw MorseException("Truncated chunk in " + filename);
+            }
+            offset = payload + size + (size & 1);
+        }
+
+        if (!haveFormat) throw MorseException("Missing fmt chunk in " + filename);
+        if (!haveData) throw MorseException("Missing data chunk in " + filename);
+        if (riffEnd < info.dataOffset + info.dataSize) {
+            info.warnings.push_back(filename + ": RIFF size " + std::to_string(riffEnd - 8) +
+                                    " is smaller than its chunks; ignoring it");
+        }
+        if (info.numChannels == 0 || info.sampleRate == 0 || info.bitsPerSample == 0 ||
+            info.blockAlign != info.numChannels * ((info.bitsPerSample + 7) / 8)) {
+            throw MorseException("Inconsistent fmt chunk in " + filename);
+        }
+        return info;
+    }
+
+    static WavInfo parse(std::istream& file, const std::string& filename) {
+        file.seekg(0, std::ios::end);
+        const auto fileSize = static_cast<uint64_t>(file.tellg());
+        return parse([&file](uint64_t offset, unsigned char* dst, uint64_t n) {
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(n));
+            return static_cast<uint64_t>(file.gcount()) == n;
+        }, fileSize, filename);
+    }
+
+    static WavInfo parse(const char* data, uint64_t size, const std::string& filename) {
+        return parse([data, size](uint64_t offset, unsigned char* dst, uint64_t n) {
+            if (offset > size || n > size - offset) return false;
+            std::memcpy(dst, data + offset, n);
+            return true;
+        }, size, filename);
+    }
+};
+
+template<typename SampleType>
+void checkSampleType(const WavInfo& info) {
+    if (info.bitsPerSample != sizeof(SampleType) * 8 ||
+        (info.audioFormat == WAVE_FORMAT_IEEE_FLOAT) != std::is_floating_point_v<SampleType>) {
+        throw MorseException("Unsupported sample type in WAV file.");
+    }
+}
+
+enum class SampleFormat { U8, S8, S16, S24, S32, F32 };
+
+inline SampleFormat formatOf(const WavInfo& info) {
+    if (info.audioFormat == WAVE_FORMAT_PCM) {
+        switch (info.bitsPerSample) {
+            case 8: return SampleFormat::U8;
+            case 16: return SampleFormat::S16;
+            case 24: return SampleFormat::S24;
+            case 32: return SampleFormat::S32;
+        }
+    } else if (info.audioFormat == WAVE_FORMAT_IEEE_FLOAT && info.bitsPerSample == 32) {
+        return SampleFormat::F32;
+    }
+    throw MorseException("Unsupported sample format: " + std::to_string(info.bitsPerSample) +
+                         "-bit, format tag " + std::to_string(info.audioFormat));
+}
+
+// 8-bit PCM is unsigned by the spec. Files written by earlier versions of this
+// tool hold signed samples instead: silence is 0x00 and 0x80 (-128) never
+// occurs. Such a file is recognised only when the first bytes contain zeros and
+// no 0x80 at all, because an unsigned recording whose carrier clips reaches 0x00
+// too, and then usually outnumbers exact 0x80 bytes when the noise floor is not
+// digital silence.
+inline SampleFormat probeFormat(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) throw MorseException("Cannot open " + filename);
+    const WavInfo info = RiffParser::parse(file, filename);
+    const SampleFormat format = formatOf(info);
+    if (format != SampleFormat::U8) return format;
+
+    std::vector<char> window(static_cast<size_t>(std::min<uint64_t>(info.dataSize, 64 * 1024)));
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(info.dataOffset));
+    file.read(window.data(), static_cast<std::streamsize>(window.size()));
+    const bool zeros = std::find(window.begin(), window.end(), '\x00') != window.end();
+    const bool biased = std::find(window.begin(), window.end(), '\x80') != window.end();
+    return zeros && !biased ? SampleFormat::S8 : SampleFormat::U8;
+}
+
+inline SampleFormat parseSampleFormat(const std::string& name) {
+    if (name == "u8") return SampleFormat::U8;
+    if (name == "s8") return SampleFormat::S8;
+    if (name == "s16") return SampleFormat::S16;
+    if (name == "s24") return SampleFormat::S24;
+    if (name == "s32") return SampleFormat::S32;
+    if (name == "f32") return SampleFormat::F32;
+    throw MorseException("Unknown sample format '" + name + "'. Use u8, s8, s16, s24, s32 or f32");
+}
+
+// Calls visit with a value of the C++ sample type matching a runtime format, so
+// one binary serves every format while each hot loop stays a template instance.
+template<typename Visitor>
+decltype(auto) withSampleType(SampleFormat format, Visitor&& visit) {
+    switch (format) {
+        case SampleFormat::U8: return visit(uint8_t{});
+        case SampleFormat::S8: return visit(int8_t{});
+        case SampleFormat::S16: return visit(int16_t{});
+        case SampleFormat::S24: return visit(Int24{});
+        case SampleFormat::S32: return visit(int32_t{});
+        case SampleFormat::F32: return visit(float{});
+    }
+    throw MorseException("Unsupported sample format.");
+}
+
+// Maps a whole file read-only with a sequential-access hint, so the kernel reads
+// ahead and drops pages behind the decoder instead of the data being copied into
+// the process. Without mmap the file is read into memory instead.
+class MappedFile {
+    const char* base = nullptr;
+    size_t length = 0;
+#ifndef MORSE_HAS_MMAP
+    std::vector<char> contents;
+#endif
+
+public:
+    explicit MappedFile(const std::string& filename) {
+#ifdef MORSE_HAS_MMAP
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) throw MorseException("Cannot open " + filename);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw MorseException("Cannot stat " + filename);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw MorseException("Cannot map " + filename);
+            }
+            ::madvise(mapping, length, MADV_SEQUENTIAL);
+            base = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
+#else
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) throw MorseException("Cannot open " + filename);
+        contents.assign(std::istreambuf_iterator<char>(file), {});
+        base = contents.data();
+        length = contents.size();
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef MORSE_HAS_MMAP
+        if (base) ::munmap(const_cast<char*>(base), length);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+// WAV file whose data chunk is used in place from the mapping. RIFF only
+// word-aligns chunks (an 18-byte fmt, or a fact chunk, can put 32-bit data at
+// offset 46), so misaligned data is copied block by block into one scratch
+// buffer of the block size rather than the whole chunk at once.
+template<typename SampleType = uint8_t>
+class MappedWav {
+    MappedFile file;
+    WavInfo info;
+    const char* start;
+    size_t count;
+    bool inPlace;
+
+public:
+    explicit MappedWav(const std::string& filename)
+        : file(filename), info(RiffParser::parse(file.data(), file.size(), filename)),
+          start(file.data() + info.dataOffset), count(static_cast<size_t>(info.dataSize / sizeof(SampleType))),
+          inPlace(reinterpret_cast<uintptr_t>(start) % alignof(SampleType) == 0) {
+        checkSampleType<SampleType>(info);
+        info.reportWarnings();
+    }
+
+    uint32_t sampleRate() const { return info.sampleRate; }
+    unsigned channels() const { return info.numChannels; }
+    uint64_t sampleCount() const { return count; }
+
+    size_t readAt(uint64_t index, size_t n, SampleType* out) const {
+        const size_t first = static_cast<size_t>(std::min<uint64_t>(index, count));
+        const size_t got = std::min(n, count - first);
+        std::memcpy(out, start + first * sizeof(SampleType), got * sizeof(SampleType));
+        return got;
+    }
+
+    template<typename Callback>
+    void forEachBlock(Callback&& onBlock, size_t blockSize) const {
+        std::vector<SampleType> scratch(inPlace ? 0 : std::min(blockSize, count));
+        for (size_t offset = 0; offset < count; offset += blockSize) {
+            const size_t n = std::min(blockSize, count - offset);
+            if (inPlace) {
+                onBlock(reinterpret_cast<const SampleType*>(start) + offset, n);
+            } else {
+                readAt(offset, n, scratch.data());
+                onBlock(static_cast<const SampleType*>(scratch.data()), n);
+            }
+        }
+    }
+};
+
+// Sinks that can hand out a writable window of n samples (claim) let parallel
+// synthesis write in place instead of through an intermediate buffer.
+template<typename Sink, typename = void>
+struct ClaimsSamples : std::false_type {};
+
+template<typename Sink>
+struct ClaimsSamples<Sink, std::void_t<decltype(std::declval<Sink&>().claim(size_t{}))>> : std::true_type {};
+
+// Online timing model for hand-sent or unknown-speed Morse. The last few mark
+// lengths, and the last few gaps longer than two units, are split into a short
+// and a long cluster (two-means on log durations). When the clusters are far
+// enough apart the split point classifies the next duration; otherwise the
+// previous split, kept as a multiple of the unit, is reused. The dot cluster
+// gives the unit, so speed changes are followed within a few characters. It
+// works per mark and gap, never per sample.
+class AdaptiveTiming {
+    static constexpr size_t WINDOW = 16;
+    static constexpr double MIN_MARK_RATIO = 2.0;   // dash/dot is nominally 3
+    static constexpr double MIN_GAP_RATIO = 1.6;    // word/character gap is 7/3 to 2
+
+    struct History {
+        std::array<double, WINDOW> values{};
+        size_t count = 0;
+        size_t next = 0;
+
+        void add(double logLength) {
+            values[next] = logLength;
+            next = (next + 1) % WINDOW;
+            count = std::min(count + 1, WINDOW);
+        }
+
+        // Otsu split of the recent log lengths: (short mean, long mean), or
+        // nothing while fewer than two values are known.
+        std::optional<std::pair<double, double>> split() const {
+            if (count < 2) return std::nullopt;
+            std::array<double, WINDOW> sorted = values;
+            std::sort(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(count));
+            double total = 0.0;
+            for (size_t i = 0; i < count; ++i) total += sorted[i];
+
+            double best = -1.0, shortMean = 0.0, longMean = 0.0, prefix = 0.0;
+            for (size_t s = 1; s < count; ++s) {
+                prefix += sorted[s - 1];
+                const double a = prefix / s;
+                const double b = (total - prefix) / (count - s);
+                const double score = static_cast<double>(s) * (count - s) * (b - a) * (b - a);
+                if (score > best) {
+                    best = score;
+                    shortMean = a;
+                    longMean = b;
+                }
+            }
+            return std::make_pair(shortMean, longMean);
+        }
+    };
+
+    double unit;              // samples
+    double wordRatio;         // character/word split, in units
+    History marks;
+    History gaps;
+
+public:
+    AdaptiveTiming(double unitSamples, double initialWordRatio) : unit(unitSamples), wordRatio(initialWordRatio) {}
+
+    bool isDash(int64_t length) {
+        marks.add(std::log(static_cast<double>(length)));
+        const auto clusters = marks.split();
+        if (clusters && clusters->second - clusters->first >= std::log(MIN_MARK_RATIO)) {
+            unit = std::exp(clusters->first);
+            return std::log(static_cast<double>(length)) >= (clusters->first + clusters->second) / 2;
+        }
+        return length >= 2 * unit;
+    }
+
+    // 0 between the elements of a character, 1 between characters, 2 between words.
+    int gapKind(int64_t length) {
+        if (length < 2 * unit) return 0;
+        gaps.add(std::log(static_cast<double>(length)));
+        const auto clusters = gaps.split();
+        if (clusters && clusters->second - clusters->first >= std::log(MIN_GAP_RATIO)) {
+            wordRatio = std::exp((clusters->first + clusters->second) / 2) / unit;
+        }
+        return length >= wordRatio * unit ? 2 : 1;
+    }
+};
+
+// Keying speed shared by the encoder and the decoder. A unit is 1.2 / wpm
+// seconds, so PARIS plus its word gap is 50 units. Every element is followed by
+// one unit of silence, and a character or word boundary adds the rest of its
+// gap (3 or 7 units in all) on top of that. A Farnsworth speed below wpm keeps
+// the characters at wpm and stretches only those two gaps, using the ARRL
+// formula. Each element rises and falls over rampMs (a raised
+// cosine) inside its own duration; the decoder ignores it.
+struct TimingProfile {
+    static constexpr double MIN_WPM = 5.0;
+    static constexpr double MAX_WPM = 60.0;
+
+    double wpm = 12.0;
+    double farnsworthWpm = 0.0;  // 0: same as wpm
+    double rampMs = 5.0;         // 0: hard keying
+
+    double unit() const { return 1.2 / wpm; }
+    double ramp() const { return rampMs / 1000; }
+    double dot() const { return unit(); }
+    double dash() const { return 3 * unit(); }
+    double symbolSpace() const { return unit(); }
+    // Added to the symbol space that ends the previous element.
+    double characterSpace() const { return 3 * spacingUnit() - symbolSpace(); }
+    double wordSpace() const { return 7 * spacingUnit() - symbolSpace(); }
+
+    // Decoder split points, halfway between the lengths the encoder produces.
+    // Gaps are measured from the end of one element to the start of the next.
+    double dashThreshold() const { return (dot() + dash()) / 2; }
+    double characterGapThreshold() const { return symbolSpace() + characterSpace() / 2; }
+    double wordGapThreshold() const { return symbolSpace() + (characterSpace() + wordSpace()) / 2; }
+
+    void validate() const {
+        if (!(wpm >= MIN_WPM && wpm <= MAX_WPM)) {
+            throw MorseException("Speed must be between " + std::to_string(static_cast<int>(MIN_WPM)) + " and " +
+                                 std::to_string(static_cast<int>(MAX_WPM)) + " WPM");
+        }
+        if (farnsworthWpm != 0.0 && !(farnsworthWpm >= MIN_WPM && farnsworthWpm <= wpm)) {
+            throw MorseException("Farnsworth speed must be between " + std::to_string(static_cast<int>(MIN_WPM)) +
+                                 " WPM and the character speed");
+        }
+        if (!(rampMs >= 0.0 && 2 * ramp() <= dot())) {
+            throw MorseException("Ramp must be between 0 ms and half a dot (" + std::to_string(std::lround(500 * dot())) + " ms)");
+        }
+    }
+
+private:
+    // A 19th of the total delay the Farnsworth formula spreads over the 3 + 7
+    // units of spacing in PARIS; one plain unit when there is no Farnsworth speed.
+    double spacingUnit() const {
+        if (farnsworthWpm == 0.0 || farnsworthWpm >= wpm) return unit();
+        return (60 * wpm - 37.2 * farnsworthWpm) / (farnsworthWpm * wpm) / 19;
+    }
+};
+
+template<typename SampleType = uint8_t>
+class WavProcessor {
+    using Traits = SampleTraits<SampleType>;
+    static constexpr double FREQUENCY = 800.0;
+    static constexpr size_t MIN_PARALLEL_CHUNK = 256 * 1024;
+
+public:
+    static constexpr uint32_t SAMPLE_RATE = 44100;
+    static constexpr double DEFAULT_CARRIER = FREQUENCY;
+    // Four samples per carrier period.
+    static constexpr uint32_t MIN_SAMPLE_RATE = static_cast<uint32_t>(4 * FREQUENCY);
+    static constexpr uint32_t MAX_SAMPLE_RATE = 384000;
+
+private:
+    // Phase-continuous keyed carrier: sample n of the stream is sin(2π·freq·n/sr)
+    // times the key envelope, as if one free-running oscillator were switched on
+    // and off, so each element picks the carrier up where the last one left it.
+    // A sample depends only on its absolute index, so segments synthesized on
+    // different threads join exactly.
+    //
+    // When the carrier repeats after a whole number of samples (441 for 800 Hz at
+    // 44.1 kHz, 10 at 8 kHz), full-amplitude periods and the ramped edges for
+    // every starting phase are tabulated once, and elements are copied straight
+    // out of the tables. Otherwise each element runs a complex rotation seeded
+    // with the exact phase of its first sample, renormalised every block.
+    class Oscillator {
+        static constexpr size_t BLOCK = 1024;
+        static constexpr size_t MIN_BODY = 4096;
+        static constexpr size_t MAX_EDGE_SAMPLES = 1 << 21;
+
+        double freq;
+        uint32_t sr;
+        size_t ramp;
+        std::vector<double> gain;          // rising edge, ramp entries
+        size_t period = 0;                 // 0: no tables, rotate
+        std::vector<SampleType> body;      // whole periods, at least MIN_BODY samples
+        std::vector<SampleType> rises;     // ramp samples per starting phase
+        std::vector<SampleType> falls;
+
+        // sin of the carrier at absolute sample n; exact for whole-hertz carriers
+        // because the phase is reduced before it is scaled.
+        double carrierAt(uint64_t n) const {
+            return std::sin(2 * M_PI * std::fmod(freq * static_cast<double>(n), static_cast<double>(sr)) / sr);
+        }
+
+        template<typename Sink>
+        void rotate(Sink& sink, uint64_t start, size_t length) const {
+            const double step = 2 * M_PI * freq / sr;
+            const double wr = std::cos(step), wi = std::sin(step);
+            const double phase = 2 * M_PI * std::fmod(freq * static_cast<double>(start), static_cast<double>(sr)) / sr;
+            double zr = std::cos(phase), zi = std::sin(phase);
+
+            std::array<SampleType, BLOCK> block;
+            for (size_t done = 0; done < length;) {
+                const size_t n = std::min(BLOCK, length - done);
+                for (size_t i = 0; i < n; ++i, ++done) {
+                    const size_t fromEdge = std::min(done, length - 1 - done);
+                    block[i] = Traits::fromUnit((fromEdge < ramp ? gain[fromEdge] : 1.0) * zi);
+                    const double r = zr * wr - zi * wi;
+                    zi = zr * wi + zi * wr;
+                    zr = r;
+                }
+                const double norm = 1.0 / std::sqrt(zr * zr + zi * zi);
+                zr *= norm;
+                zi *= norm;
+                sink.append(block.data(), n);
+            }
+        }
+
+    public:
+        // ramp is the edge length in samples, at most half the shortest element.
+        Oscillator(double frequency, uint32_t sampleRate, size_t rampSamples)
+            : freq(frequency), sr(sampleRate), ramp(rampSamples), gain(rampSamples) {
+            for (size_t i = 0; i < ramp; ++i) gain[i] = 0.5 - 0.5 * std::cos(M_PI * (i + 0.5) / ramp);
+
+            if (freq != std::floor(freq) || freq <= 0.0 || freq >= sr) return;
+            const uint64_t cycle = sr / std::gcd<uint64_t>(sr, static_cast<uint64_t>(freq));
+            if (cycle * ramp * 2 > MAX_EDGE_SAMPLES) return;
+            period = static_cast<size_t>(cycle);
+
+            body.resize((MIN_BODY + period - 1) / period * period);
+            for (size_t i = 0; i < body.size(); ++i) body[i] = Traits::fromUnit(carrierAt(i));
+            rises.resize(period * ramp);
+            falls.resize(period * ramp);
+            for (size_t p = 0; p < period; ++p) {
+                for (size_t i = 0; i < ramp; ++i) {
+                    const double carrier = carrierAt(p + i);
+                    rises[p * ramp + i] = Traits::fromUnit(gain[i] * carrier);
+                    falls[p * ramp + i] = Traits::fromUnit(gain[ramp - 1 - i] * carrier);
+                }
+            }
+        }
+
+        // Appends the element of the given length that starts at absolute sample start.
+        template<typename Sink>
+        void key(Sink& sink, uint64_t start, size_t length) const {
+            if constexpr (std::is_same_v<Sink, CountingSink>) {
+                sink.appendSilence(length);  // the sizing pass only needs the length
+                return;
+            }
+            if (period == 0) {
+                rotate(sink, start, length);
+                return;
+            }
+            if (ramp) sink.append(&rises[start % period * ramp], ramp);
+            const uint64_t end = start + length - ramp;
+            for (uint64_t pos = start + ramp; pos < end;) {
+                const size_t offset = static_cast<size_t>(pos % period);
+                const size_t run = static_cast<size_t>(std::min<uint64_t>(end - pos, body.size() - offset));
+                sink.append(&body[offset], run);
+                pos += run;
+            }
+            if (ramp) sink.append(&falls[end % period * ramp], ramp);
+        }
+    };
+
+public:
+    // Turns a Morse symbol stream into samples pushed to a sink. Space runs may
+    // straddle successive feed() calls, so the input can arrive in chunks. start
+    // is the absolute index of the first sample, which fixes the carrier phase.
+    template<typename Sink>
+    class Generator {
+        Sink& sink;
+        const Oscillator& oscillator;
+        size_t dot;
+        size_t dash;
+        size_t symbolSpace;
+        size_t characterSpace;
+        size_t wordSpace;
+        uint64_t position;
+        size_t pendingSpaces = 0;
+
+        void silence(size_t n) {
+            sink.appendSilence(n);
+            position += n;
+        }
+
+        void flushSpaces() {
+            if (pendingSpaces == 1) {
+                silence(characterSpace);
+            } else if (pendingSpaces >= 3) {
+                silence(wordSpace);
+            }
+            pendingSpaces = 0;
+        }
+
+    public:
+        explicit Generator(Sink& out, uint32_t sr = SAMPLE_RATE, const TimingProfile& timing = {}, uint64_t start = 0)
+            : sink(out), oscillator(cachedOscillator(FREQUENCY, sr, std::min(samplesIn(timing.ramp(), sr), samplesIn(timing.dot(), sr) / 2))),
+              dot(samplesIn(timing.dot(), sr)), dash(samplesIn(timing.dash(), sr)),
+              symbolSpace(samplesIn(timing.symbolSpace(), sr)), characterSpace(samplesIn(timing.characterSpace(), sr)),
+              wordSpace(samplesIn(timing.wordSpace(), sr)), position(start) {}
+
+        void feed(std::string_view morse) {
+            for (char c : morse) {
+                if (c == ' ') {
+                    pendingSpaces++;
+                    continue;
+                }
+                flushSpaces();
+                if (c == '.' || c == '-') {
+                    const size_t length = (c == '.') ? dot : dash;
+                    oscillator.key(sink, position, length);
+                    position += length;
+                    silence(symbolSpace);
+                }
+            }
+        }
+
+        void finish() { flushSpaces(); }
+    };
+
+    // Drop-in replacement for Generator that synthesizes on several threads. Morse
+    // is buffered and cut only where a space run ends, the one point where the
+    // sequential generator carries no state; each segment's exact size comes from
+    // the sizing pass, so workers write into fixed offsets of a shared buffer that
+    // is handed to the sink in order. Output is identical to Generator's.
+    template<typename Sink>
+    class ParallelGenerator {
+        Sink& sink;
+        unsigned threads;
+        uint32_t sr;
+        TimingProfile timing;
+        uint64_t emitted = 0;
+        std::string pending;
+        std::vector<SampleType> buffer;
+
+        static bool isCut(std::string_view morse, size_t pos) {
+            return pos > 0 && pos < morse.size() && morse[pos - 1] == ' ' && morse[pos] != ' ';
+        }
+
+        // Renders one window of whole characters, split across the threads.
+        void synthesize(std::string_view morse) {
+            const size_t length = morse.size();
+            std::vector<size_t> bounds{0};
+            for (unsigned t = 1; t < threads; ++t) {
+                size_t pos = std::max(bounds.back(), length * t / threads);
+                while (pos < length && !isCut(morse, pos)) ++pos;
+                if (pos >= length) break;
+                if (pos > bounds.back()) bounds.push_back(pos);
+            }
+            bounds.push_back(length);
+
+            std::vector<size_t> offsets{0};
+            for (size_t k = 0; k + 1 < bounds.size(); ++k) {
+                offsets.push_back(offsets.back() + countSamples(morse.substr(bounds[k], bounds[k + 1] - bounds[k]), sr, timing));
+            }
+            SampleType* target;
+            if constexpr (ClaimsSamples<Sink>::value) {
+                target = sink.claim(offsets.back());
+            } else {
+                buffer.resize(offsets.back());
+                target = buffer.data();
+            }
+
+            std::vector<std::thread> workers;
+            for (size_t k = 0; k + 1 < bounds.size(); ++k) {
+                workers.emplace_back([this, target, morse, &bounds, &offsets, k] {
+                    PointerSink<SampleType> out(target + offsets[k]);
+                    Generator<PointerSink<SampleType>> generator(out, sr, timing, emitted + offsets[k]);
+                    generator.feed(morse.substr(bounds[k], bounds[k + 1] - bounds[k]));
+                    generator.finish();
+                });
+            }
+            for (auto& worker : workers) worker.join();
+
+            if constexpr (!ClaimsSamples<Sink>::value) sink.append(buffer.data(), buffer.size());
+            emitted += offsets.back();
+        }
+
+    public:
+        static constexpr size_t SYMBOLS_PER_THREAD = 256;
+
+        ParallelGenerator(Sink& out, unsigned threadCount, uint32_t sampleRate = SAMPLE_RATE, const TimingProfile& keying = {})
+            : sink(out), threads(std::max(1u, threadCount)), sr(sampleRate), timing(keying) {}
+
+        // Windows hold at most threads * SYMBOLS_PER_THREAD symbols where a cut
+        // allows it, so the staging buffer stays small however large the chunk.
+        void feed(std::string_view morse) {
+            pending += morse;
+            const size_t window = threads * SYMBOLS_PER_THREAD;
+            const std::string_view text(pending);
+            size_t done = 0;
+            while (text.size() - done >= window) {
+                const std::string_view rest = text.substr(done);
+                size_t cut = window;
+                while (cut > 0 && !isCut(rest, cut)) --cut;
+                if (cut == 0) {
+                    cut = window;
+                    while (cut < rest.size() && !isCut(rest, cut)) ++cut;
+                    if (cut == rest.size()) break;
+                }
+                synthesize(rest.substr(0, cut));
+                done += cut;
+            }
+            pending.erase(0, done);
+        }
+
+        void finish() {
+            if (!pending.empty()) synthesize(pending);
+            pending.clear();
+        }
+    };
 
-    char dataId[4] = {'d', 'a', 't', 'a'};
-    uint32_t dataSize;
-};
+    static uint64_t countSamples(std::string_view morse, uint32_t sr = SAMPLE_RATE, const TimingProfile& timing = {}) {
+        CountingSink counter;
+        Generator<CountingSink> generator(counter, sr, timing);
+        generator.feed(morse);
+        generator.finish();
+        return counter.count();
+    }
 
-class MorseException : public std::exception {
-    std::string msg;
-public:
-    explicit MorseException(std::string message) : msg(std::move(message)) {}
-    const char* what() const noexcept override { return msg.c_str(); }
-};
+    static AudioPlan makePlan(uint64_t sampleCount, uint32_t sr = SAMPLE_RATE) {
+        AudioPlan plan;
+        plan.sampleCount = sampleCount;
+        plan.durationSeconds = static_cast<double>(sampleCount) / sr;
+        plan.fileBytes = sizeof(WavHeader) + sampleCount * sizeof(SampleType);
+        return plan;
+    }
 
-class MorseBase {
-public:
-    virtual ~MorseBase() noexcept = default;
-    virtual std::string encode(const std::string& text) = 0;
-    virtual std::string decode(const std::string& morse) = 0;
-};
+    static WavHeader makeHeader(uint64_t sampleCount, uint32_t sr = SAMPLE_RATE) {
+        const uint64_t dataSize = sampleCount * sizeof(SampleType);
+        if (dataSize > std::numeric_limits<uint32_t>::max() - sizeof(WavHeader)) {
+            throw MorseException("Audio too long for a WAV file.");
+        }
+
+        WavHeader header;
+        header.audioFormat = std::is_floating_point_v<SampleType> ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+        header.sampleRate = sr;
+        header.dataSize = static_cast<uint32_t>(dataSize);
+        header.riffSize = header.dataSize + sizeof(WavHeader) - 8;
+        header.bitsPerSample = sizeof(SampleType) * 8;
+        header.byteRate = header.sampleRate * header.numChannels * sizeof(SampleType);
+        header.blockAlign = header.numChannels * sizeof(SampleType);
+        return header;
+    }
 
-class MorseConverter : public MorseBase {
 private:
-    std::map<char, std::string> charToMorse;
-    std::map<std::string, char> morseToChar;
-
-    void initMaps() {
-        const std::vector<std::pair<char, std::string>> mappings = {
-            {'A', ".-"}, {'B', "-..."}, {'C', "-.-."}, {'D', "-.."}, {'E', "."},
-            {'F', "..-."}, {'G', "--."}, {'H', "...."}, {'I', ".."}, {'J', ".---"},
-            {'K', "-.-"}, {'L', ".-.."}, {'M', "--"}, {'N', "-."}, {'O', "---"},
-            {'P', ".--."}, {'Q', "--.-"}, {'R', ".-."}, {'S', "..."}, {'T', "-"},
-            {'U', "..-"}, {'V', "...-"}, {'W', ".--"}, {'X', "-..-"}, {'Y', "-.--"},
-            {'Z', "--.."}, {'0', "-----"}, {'1', ".----"}, {'2', "..---"}, {'3', "...--"},
-            {'4', "....-"}, {'5', "....."}, {'6', "-...."}, {'7', "--..."}, {'8', "---.."},
-            {'9', "----."}, {'.', ".-.-.-"}, {',', "--..--"}, {'?', "..--.."}, {' ', "   "}
-        };
+    // Nearest whole sample count, so durations derived from the speed do not lose
+    // a sample to floating-point error (0.7 s is 30869.99... samples at 44.1 kHz).
+    static size_t samplesIn(double seconds, uint32_t sr) { return static_cast<size_t>(std::llround(seconds * sr)); }
 
-        for (const auto& [c, s] : mappings) {
-            charToMorse[c] = s;
-            morseToChar[s] = c;
+    // Oscillator tables, ramps included, are built once per (frequency, rate,
+    // ramp), so shaping costs nothing per generated sample; the sample type is
+    // part of the key through the class template. The ramp is a raised cosine
+    // sampled at half-sample offsets so rise and fall mirror each other exactly;
+    // keying a bare sine on and off splatters energy far from the carrier (key
+    // clicks) that neighbouring and downstream detectors pick up. Entries are
+    // never erased, so the returned references stay valid for the program's life.
+    static const Oscillator& cachedOscillator(double freq, uint32_t sr, size_t ramp) {
+        static std::mutex mutex;
+        static std::map<std::tuple<double, uint32_t, size_t>, Oscillator> cache;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto key = std::make_tuple(freq, sr, ramp);
+        auto it = cache.find(key);
+        if (it == cache.end()) {
+            it = cache.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(freq, sr, ramp)).first;
         }
+        return it->second;
     }
 
 public:
-    MorseConverter() { initMaps(); }
-    ~MorseConverter() noexcept override = default;
+    // Tone/silence state machine that can be fed consecutive sample blocks;
+    // positions are absolute so results do not depend on the block size.
+    // Samples are first reduced to tone/silence runs, and debounce and timing
+    // work per run: a run opposite to the current state switches it once it
+    // reaches the debounce length, exactly where the per-sample counter would.
+    class Detector {
+        int64_t debounce_threshold;
+        int64_t gap_bridge;
+        int64_t dash_threshold;
+        int64_t char_gap_threshold;
+        int64_t word_gap_threshold;
+        bool in_tone = false;
+        int64_t position = 0;
+        int64_t tone_start = 0;
+        int64_t silence_start = -1;
+        int64_t debounce_counter = 0;
+        int64_t pending_gap = 0;
+        bool gap_open = true;
+        std::optional<GoertzelScanner<SampleType>> goertzel;
+        std::optional<AdaptiveTiming> adaptive;
+        std::vector<ToneRun> runs;
+        std::vector<std::vector<ToneRun>> chunkRuns;
 
-    std::string encode(const std::string& text) override {
-        std::string morse;
-        bool prev_was_space = false;
-        for (char c : text) {
-            c = std::toupper(c);
-            if (c == ' ') {
-                morse += "   ";
-                prev_was_space = true;
-            } else {
-                if (!morse.empty() && !prev_was_space) morse += ' ';
-                if (charToMorse.count(c)) {
-                    morse += charToMorse.at(c);
-                } else {
-                    throw MorseException("Character '" + std::string(1, c) + "' cannot be encoded in Morse.");
+        // Smallest sample count lasting at least the given time at this rate, so
+        // run lengths are classified with integer compares that agree exactly
+        // with comparing durations in seconds.
+        static int64_t samplesFor(double seconds, uint32_t sr) {
+            auto n = static_cast<int64_t>(std::ceil(seconds * sr));
+            while (n > 0 && (n - 1) / static_cast<double>(sr) >= seconds) --n;
+            while (n / static_cast<double>(sr) < seconds) ++n;
+            return n;
+        }
+
+        void onToneStart(int64_t i, std::string& morse) {
+            if (silence_start != -1) {
+                const int64_t silence_length = i - silence_start;
+                const int kind = adaptive ? adaptive->gapKind(silence_length)
+                                 : silence_length >= word_gap_threshold ? 2
+                                 : silence_length >= char_gap_threshold ? 1 : 0;
+                if (kind == 2) {
+                    morse += "   ";
+                } else if (kind == 1) {
+                    morse += " ";
                 }
-                prev_was_space = false;
+                silence_start = -1;
             }
+            tone_start = i;
         }
-        return morse;
-    }
 
-    std::string decode(const std::string& morse) override {
-        std::string text;
-        size_t pos = 0, prev = 0;
-        std::vector<std::string> words;
-        while ((pos = morse.find("   ", prev)) != std::string::npos) {
-            words.push_back(morse.substr(prev, pos - prev));
-            prev = pos + 3;
+        void onToneEnd(int64_t i, std::string& morse) {
+            const bool dash = adaptive ? adaptive->isDash(i - tone_start) : i - tone_start >= dash_threshold;
+            morse += dash ? '-' : '.';
+            silence_start = i;
+        }
+
+    public:
+        // Every threshold is a duration converted once to samples at the stream's
+        // own rate, so 8 kHz and 96 kHz captures decode without resampling.
+        // The Goertzel detector listens at carrier Hz, or at DEFAULT_CARRIER when it
+        // is 0. Adaptive timing starts from the profile's unit and word split and
+        // follows the sender's speed from there.
+        explicit Detector(uint32_t sampleRate, ToneDetection detection = ToneDetection::Envelope, double carrier = 0.0,
+                          bool adaptiveTiming = false, const TimingProfile& timing = {})
+            : debounce_threshold(std::max<int64_t>(1, std::llround(sampleRate * 0.001))),
+              gap_bridge(debounce_threshold),
+              dash_threshold(samplesFor(timing.dashThreshold(), sampleRate)),
+              char_gap_threshold(samplesFor(timing.characterGapThreshold(), sampleRate)),
+              word_gap_threshold(samplesFor(timing.wordGapThreshold(), sampleRate)) {
+            if (detection == ToneDetection::Goertzel) goertzel.emplace(sampleRate, carrier > 0.0 ? carrier : DEFAULT_CARRIER);
+            if (adaptiveTiming) adaptive.emplace(timing.unit() * sampleRate, timing.wordGapThreshold() / timing.unit());
         }
-        words.push_back(morse.substr(prev));
 
-        for (size_t i = 0; i < words.size(); ++i) {
-            std::istringstream iss(words[i]);
-            std::string token;
-            while (iss >> token) {
-                if (morseToChar.count(token))
-                    text.push_back(morseToChar.at(token));
+        // With several threads the block is cut into contiguous chunks whose runs
+        // are extracted concurrently. Only the run pass carries state, and a run cut
+        // at a chunk edge is reconciled by the debounce counter carried into the next
+        // chunk's first run, so the result is identical to the sequential pass.
+        void feed(const SampleType* samples, size_t n, std::string& morse, unsigned threads = 1) {
+            if (goertzel) {
+                runs.clear();
+                goertzel->scan(samples, n, runs, threads);
+                feedRuns(runs.data(), runs.size(), morse);
+                return;
+            }
+            if (threads <= 1 || n < threads * MIN_PARALLEL_CHUNK) {
+                runs.clear();
+                EnvelopeScanner<SampleType>::scan(samples, n, Traits::MAX_LEVEL / 100, runs);
+                feedRuns(runs.data(), runs.size(), morse);
+                return;
+            }
+
+            const size_t chunk = (n / threads + 63) & ~static_cast<size_t>(63);
+            chunkRuns.resize(threads);
+            std::vector<std::thread> workers;
+            for (unsigned t = 0; t < threads && t * chunk < n; ++t) {
+                workers.emplace_back([this, samples, n, chunk, t] {
+                    const size_t begin = t * chunk;
+                    chunkRuns[t].clear();
+                    EnvelopeScanner<SampleType>::scan(samples + begin, std::min(chunk, n - begin), Traits::MAX_LEVEL / 100, chunkRuns[t]);
+                });
+            }
+            for (auto& worker : workers) worker.join();
+            for (size_t t = 0; t < workers.size(); ++t) {
+                feedRuns(chunkRuns[t].data(), chunkRuns[t].size(), morse);
             }
-            if (i != words.size() - 1)
-                text.push_back(' ');
         }
-        return text;
-    }
-};
 
-template<typename SampleType = int8_t>
-class WavProcessor {
-    static constexpr SampleType MAX_AMP = std::numeric_limits<SampleType>::max();
-    static constexpr double DOT_DURATION = 0.1;
-    static constexpr double DASH_DURATION = 0.3;
-    static constexpr double SYMBOL_SPACE = 0.1;
-    static constexpr double WORD_SPACE = 0.7;
+        // Releases anything the detector still holds back (the Goertzel scanner's
+        // noise seeding window); call once after the last feed().
+        void finish(std::string& morse) {
+            if (!goertzel) return;
+            runs.clear();
+            goertzel->finish(runs);
+            feedRuns(runs.data(), runs.size(), morse);
+        }
 
-public:
-    static std::vector<SampleType> generateSamples(const std::string& morse) {
-        std::vector<SampleType> samples;
-        const double freq = 800.0;
-        const int sr = 44100;
+        // Dips of the carrier below the threshold near its zero crossings are
+        // shorter than gap_bridge and count as tone; a gap only becomes silence
+        // once it lasts that long. Without this, a carrier whose half period is
+        // shorter than the debounce never registers at rates where samples land
+        // on the zero crossings (8 kHz, 48 kHz).
+        void feedRuns(const ToneRun* data, size_t count, std::string& morse) {
+            for (size_t r = 0; r < count; ++r) {
+                const ToneRun& run = data[r];
+                const int64_t length = static_cast<int64_t>(run.length);
+                if (run.tone) {
+                    if (pending_gap > 0) step(true, pending_gap, morse);
+                    pending_gap = 0;
+                    gap_open = false;
+                    step(true, length, morse);
+                } else if (gap_open) {
+                    step(false, length, morse);
+                } else if ((pending_gap += length) >= gap_bridge) {
+                    step(false, pending_gap, morse);
+                    pending_gap = 0;
+                    gap_open = true;
+                }
+            }
+        }
 
-        size_t i = 0;
-        while (i < morse.size()) {
-            char c = morse[i];
-            if (c == '.' || c == '-') {
-                if (c == '.') {
-                    addSine(samples, DOT_DURATION, freq, sr);
+    private:
+        void step(bool tone, int64_t length, std::string& morse) {
+            if (tone != in_tone) {
+                const int64_t needed = debounce_threshold - debounce_counter;
+                if (length >= needed) {
+                    const int64_t i = position + needed - 1;
+                    in_tone = tone;
+                    debounce_counter = 0;
+                    if (in_tone) {
+                        onToneStart(i, morse);
+                    } else {
+                        onToneEnd(i, morse);
+                    }
                 } else {
-                    addSine(samples, DASH_DURATION, freq, sr);
-                }
-                addSilence(samples, SYMBOL_SPACE, sr);
-                i++;
-            } else if (c == ' ') {
-                size_t spaceCount = 0;
-                while (i < morse.size() && morse[i] == ' ') {
-                    spaceCount++;
-                    i++;
-                }
-                if (spaceCount == 1) {
-                    addSilence(samples, SYMBOL_SPACE * 3, sr);
-                } else if (spaceCount >= 3) {
-                    addSilence(samples, WORD_SPACE, sr);
+                    debounce_counter += length;
                 }
             } else {
-                i++;
+                debounce_counter = 0;
             }
+            position += length;
         }
+    };
+};
 
-        return samples;
-    }
+// Streams samples straight to disk and back-patches the header sizes on finish(),
+// so the full sample vector never has to exist in memory.
+template<typename SampleType = uint8_t>
+class WavWriter {
+    std::string filename;
+    std::ofstream file;
+    uint32_t sampleRate;
+    uint64_t sampleCount = 0;
+    bool finished = false;
 
-    static void saveWav(const std::string& filename, const std::vector<SampleType>& samples) {
-        std::ofstream file(filename, std::ios::binary);
+public:
+    explicit WavWriter(const std::string& path, uint32_t rate = WavProcessor<SampleType>::SAMPLE_RATE)
+        : filename(path), file(path, std::ios::binary), sampleRate(rate) {
         if (!file) throw MorseException("Cannot open " + filename);
+        const WavHeader placeholder = WavProcessor<SampleType>::makeHeader(0, sampleRate);
+        file.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+    }
 
-        WavHeader header;
-        header.dataSize = static_cast<uint32_t>(samples.size() * sizeof(SampleType));
-        header.riffSize = header.dataSize + sizeof(WavHeader) - 8;
-        header.bitsPerSample = sizeof(SampleType) * 8;
-        header.byteRate = header.sampleRate * header.numChannels * sizeof(SampleType);
-        header.blockAlign = header.numChannels * sizeof(SampleType);
+    ~WavWriter() {
+        if (!finished) {
+            file.close();
+            std::remove(filename.c_str());
+        }
+    }
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    void append(const SampleType* data, size_t n) {
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(n * sizeof(SampleType)));
+        sampleCount += n;
+    }
+
+    void appendSilence(size_t n) {
+        static const auto silence = [] {
+            std::array<SampleType, 4096> block;
+            block.fill(SampleTraits<SampleType>::silence());
+            return block;
+        }();
+        while (n > 0) {
+            const size_t count = std::min(n, silence.size());
+            append(silence.data(), count);
+            n -= count;
+        }
+    }
 
+    void finish() {
+        const WavHeader header = WavProcessor<SampleType>::makeHeader(sampleCount, sampleRate);
+        file.seekp(0);
         file.write(reinterpret_cast<const char*>(&header), sizeof(header));
-        file.write(reinterpret_cast<const char*>(samples.data()),
-                   static_cast<std::streamsize>(samples.size() * sizeof(SampleType)));
+        file.flush();
+        if (!file) throw MorseException("Cannot write " + filename);
+        finished = true;
     }
+};
 
-    static std::string loadWav(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary);
-        if (!file) throw MorseException("Cannot open " + filename);
+#ifdef MORSE_HAS_MMAP
+// Preallocates the output at its exact final size, maps it and lets the
+// generator write samples straight into the mapping. The size must come from
+// the sizing pass; finish() checks that exactly that many samples arrived.
+template<typename SampleType = uint8_t>
+class MappedWavWriter {
+    std::string filename;
+    char* base = nullptr;
+    size_t length = 0;
+    SampleType* cursor = nullptr;
+    SampleType* end = nullptr;
+    bool finished = false;
 
-        WavHeader header;
-        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+public:
+    MappedWavWriter(const std::string& path, uint64_t sampleCount,
+                    uint32_t sampleRate = WavProcessor<SampleType>::SAMPLE_RATE) : filename(path) {
+        const WavHeader header = WavProcessor<SampleType>::makeHeader(sampleCount, sampleRate);
+        length = sizeof(header) + header.dataSize;
 
-        if (header.bitsPerSample != sizeof(SampleType) * 8) {
-            throw MorseException("Unsupported sample type in WAV file.");
+        const int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw MorseException("Cannot open " + filename);
+#ifdef __linux__
+        const bool allocated = ::fallocate(fd, 0, 0, static_cast<off_t>(length)) == 0 ||
+                               ::ftruncate(fd, static_cast<off_t>(length)) == 0;
+#else
+        const bool allocated = ::ftruncate(fd, static_cast<off_t>(length)) == 0;
+#endif
+        void* mapping = allocated ? ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            std::remove(filename.c_str());
+            throw MorseException("Cannot allocate " + filename);
         }
+        ::madvise(mapping, length, MADV_SEQUENTIAL);
 
-        std::vector<SampleType> samples(header.dataSize / sizeof(SampleType));
-        file.read(reinterpret_cast<char*>(samples.data()),
-                  static_cast<std::streamsize>(header.dataSize));
+        base = static_cast<char*>(mapping);
+        std::memcpy(base, &header, sizeof(header));
+        cursor = reinterpret_cast<SampleType*>(base + sizeof(header));
+        end = cursor + sampleCount;
+    }
 
-        return decodeSamples(samples, header.sampleRate);
+    ~MappedWavWriter() {
+        ::munmap(base, length);
+        if (!finished) std::remove(filename.c_str());
     }
 
-private:
-    static void addSine(std::vector<SampleType>& samples, double duration, double freq, int sr) {
-        const int n = static_cast<int>(duration * sr);
-        const double step = 2 * M_PI * freq / sr;
+    MappedWavWriter(const MappedWavWriter&) = delete;
+    MappedWavWriter& operator=(const MappedWavWriter&) = delete;
 
-        for (int i = 0; i < n; ++i) {
-            samples.push_back(static_cast<SampleType>(MAX_AMP * std::sin(step * i)));
-        }
+    SampleType* claim(size_t n) {
+        if (n > static_cast<size_t>(end - cursor)) throw MorseException("Output larger than planned: " + filename);
+        SampleType* window = cursor;
+        cursor += n;
+        return window;
     }
 
-    static void addSilence(std::vector<SampleType>& samples, double duration, int sr) {
-        const int n = static_cast<int>(duration * sr);
-        samples.insert(samples.end(), n, static_cast<SampleType>(0));
+    void append(const SampleType* data, size_t n) { std::memcpy(claim(n), data, n * sizeof(SampleType)); }
+    void appendSilence(size_t n) { std::fill_n(claim(n), n, SampleTraits<SampleType>::silence()); }
+
+    void finish() {
+        if (cursor != end) throw MorseException("Output shorter than planned: " + filename);
+        finished = true;
     }
+};
+#endif
 
-    static std::string decodeSamples(const std::vector<SampleType>& samples, uint32_t sr) {
-        std::string morse;
-        const auto threshold = MAX_AMP / 100;
-        bool in_tone = false;
-        int tone_start = 0;
-        int silence_start = -1;
-        int debounce_counter = 0;
-        const int debounce_threshold = static_cast<int>(sr * 0.001);
-
-        for (size_t i = 0; i < samples.size(); ++i) {
-            if (std::abs(samples[i]) > threshold) {
-                if (!in_tone) {
-                    if (++debounce_counter >= debounce_threshold) {
-                        in_tone = true;
-                        debounce_counter = 0;
-
-                        if (silence_start != -1) {
-                            double silence_duration = (i - silence_start) / static_cast<double>(sr);
-                            if (silence_duration >= 0.79) {
-                                morse += "   ";
-                            } else if (silence_duration >= 0.39) {
-                                morse += " ";
-                            }
-                            silence_start = -1;
-                        }
-                        tone_start = i;
-                    }
-                } else {
-                    debounce_counter = 0;
-                }
-            } else {
-                if (in_tone) {
-                    if (++debounce_counter >= debounce_threshold) {
-                        in_tone = false;
-                        debounce_counter = 0;
-                        double tone_duration = (i - tone_start) / static_cast<double>(sr);
-                        morse += (tone_duration < (DOT_DURATION + DASH_DURATION) / 2) ? '.' : '-';
-                        silence_start = i;
-                    }
-                } else {
-                    debounce_counter = 0;
-                }
-            }
+// Reads the data chunk in fixed-size blocks so decoding runs in constant memory.
+template<typename SampleType = uint8_t>
+class WavReader {
+    std::ifstream file;
+    WavInfo info;
+
+public:
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+    explicit WavReader(const std::string& filename) : file(filename, std::ios::binary) {
+        if (!file) throw MorseException("Cannot open " + filename);
+        info = RiffParser::parse(file, filename);
+        checkSampleType<SampleType>(info);
+        info.reportWarnings();
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(info.dataOffset));
+    }
+
+    uint32_t sampleRate() const { return info.sampleRate; }
+    unsigned channels() const { return info.numChannels; }
+    uint64_t sampleCount() const { return info.dataSize / sizeof(SampleType); }
+
+    // Random access for the carrier search; forEachBlock rewinds afterwards.
+    size_t readAt(uint64_t index, size_t n, SampleType* out) {
+        if (index >= sampleCount()) return 0;
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(info.dataOffset + index * sizeof(SampleType)));
+        const size_t wanted = static_cast<size_t>(std::min<uint64_t>(n, sampleCount() - index));
+        file.read(reinterpret_cast<char*>(out), static_cast<std::streamsize>(wanted * sizeof(SampleType)));
+        return static_cast<size_t>(file.gcount()) / sizeof(SampleType);
+    }
+
+    template<typename Callback>
+    void forEachBlock(Callback&& onBlock, size_t blockSize = BLOCK_SIZE) {
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(info.dataOffset));
+        std::vector<SampleType> block(blockSize);
+        uint64_t remaining = info.dataSize / sizeof(SampleType);
+        while (remaining > 0 && file) {
+            const size_t wanted = static_cast<size_t>(std::min<uint64_t>(remaining, block.size()));
+            file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(wanted * sizeof(SampleType)));
+            const size_t n = static_cast<size_t>(file.gcount()) / sizeof(SampleType);
+            if (n == 0) break;
+            onBlock(block.data(), n);
+            remaining -= n;
         }
-        std::cout << "Decoded Morse: " << morse << std::endl;
-        return morse;
     }
 };
 
 class FileHandler {
 public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    template<typename Callback>
+    static void readChunks(const std::string& filename, Callback&& onChunk) {
+        std::ifstream file(filename);
+        if (!file) throw MorseException("Cannot read " + filename);
+        std::vector<char> buffer(CHUNK_SIZE);
+        while (file) {
+            file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            const auto n = static_cast<size_t>(file.gcount());
+            if (n > 0) onChunk(std::string_view(buffer.data(), n));
+        }
+    }
+
     static std::string read(const std::string& filename) {
         std::ifstream file(filename);
         if (!file) throw MorseException("Cannot read " + filename);
@@ -275,44 +2075,576 @@ public:
 
 class MorseEncoder : public MorseBase {
     MorseConverter converter;
+    unsigned threads;
+    SampleFormat format;
+    uint32_t sampleRate;
+    TimingProfile timing;
 public:
+    explicit MorseEncoder(unsigned threadCount = std::thread::hardware_concurrency(),
+                          SampleFormat sampleFormat = SampleFormat::U8,
+                          uint32_t outputRate = WavProcessor<>::SAMPLE_RATE, TimingProfile keying = {})
+        : threads(std::max(1u, threadCount)), format(sampleFormat), sampleRate(outputRate), timing(keying) {
+        if (sampleRate < WavProcessor<>::MIN_SAMPLE_RATE || sampleRate > WavProcessor<>::MAX_SAMPLE_RATE) {
+            throw MorseException("Sample rate must be between " + std::to_string(WavProcessor<>::MIN_SAMPLE_RATE) +
+                                 " and " + std::to_string(WavProcessor<>::MAX_SAMPLE_RATE) + " Hz");
+        }
+        timing.validate();
+    }
+
     std::string encode(const std::string& text) override { return converter.encode(text); }
     std::string decode(const std::string&) override { throw MorseException("Encoder cannot decode"); }
 
+    // Sizing pass over the text: same chunked pipeline, but samples are only counted.
+    AudioPlan planFile(const std::string& input) const {
+        CountingSink counter;
+        WavProcessor<>::Generator<CountingSink> generator(counter, sampleRate, timing);
+        pipe(input, generator);
+        return withSampleType(format, [&](auto tag) {
+            return WavProcessor<decltype(tag)>::makePlan(counter.count(), sampleRate);
+        });
+    }
+
+    // Text chunk -> Morse chunk -> samples -> disk; memory use does not grow with the input.
+    // Oversized jobs are rejected by the sizing pass before anything is written. Where
+    // mmap is available the output is preallocated at its planned size and the
+    // samples are synthesized directly into the mapped file.
     void encodeFile(const std::string& input, const std::string& output) {
-        const auto text = FileHandler::read(input);
-        const auto morse = encode(text);
-        const auto samples = WavProcessor<>::generateSamples(morse); // par défaut int16_t
-        WavProcessor<>::saveWav(output, samples);
+        const AudioPlan plan = planFile(input);
+        if (plan.fileBytes > std::numeric_limits<uint32_t>::max()) {
+            throw MorseException("Audio for " + input + " would take " + std::to_string(plan.fileBytes) +
+                                 " bytes; a WAV file holds at most 4 GiB.");
+        }
+        withSampleType(format, [&](auto tag) {
+            using SampleType = decltype(tag);
+#ifdef MORSE_HAS_MMAP
+            MappedWavWriter<SampleType> writer(output, plan.sampleCount, sampleRate);
+#else
+            WavWriter<SampleType> writer(output, sampleRate);
+#endif
+            synthesize<SampleType>(input, writer);
+            writer.finish();
+        });
+    }
+
+private:
+    template<typename SampleType, typename Sink>
+    void synthesize(const std::string& input, Sink& sink) const {
+        if (threads > 1) {
+            typename WavProcessor<SampleType>::template ParallelGenerator<Sink> generator(sink, threads, sampleRate, timing);
+            pipe(input, generator);
+        } else {
+            typename WavProcessor<SampleType>::template Generator<Sink> generator(sink, sampleRate, timing);
+            pipe(input, generator);
+        }
+    }
+
+    template<typename Generator>
+    void pipe(const std::string& input, Generator& generator) const {
+        MorseConverter::EncodeState state;
+        std::string morse;
+
+        FileHandler::readChunks(input, [&](std::string_view chunk) {
+            morse.clear();
+            converter.encodeChunk(chunk, state, morse);
+            generator.feed(morse);
+        });
+        generator.finish();
+    }
+};
+
+// Which channel(s) of a multi-channel file the decoder listens to.
+struct ChannelSelection {
+    enum class Mode { Single, Mix, All };
+    Mode mode = Mode::Single;
+    unsigned channel = 0;
+
+    // Accepts a channel index, "mix" or "all".
+    static ChannelSelection parse(const std::string& name) {
+        if (name == "mix") return {Mode::Mix, 0};
+        if (name == "all") return {Mode::All, 0};
+        if (name.empty() || name.size() > 5 || !std::all_of(name.begin(), name.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            throw MorseException("Unknown channel '" + name + "' (use an index, mix or all)");
+        }
+        return {Mode::Single, static_cast<unsigned>(std::stoul(name))};
     }
 };
 
+// Decoder options beyond echo and thread count. A non-zero decimateTo detects at
+// the lowest exact working rate at or above it. Carriers (given, or found when
+// findCarriers is non-zero) imply the Goertzel detector; more than one, or a
+// search for more than one, decodes each carrier into its own file. Fixed
+// timing expects the speed in timing; adaptive timing starts from it. A format
+// overrides the one read from the file (s8 for legacy 8-bit files the probe
+// takes for unsigned).
+struct DecoderSettings {
+    std::optional<SampleFormat> format;
+    ChannelSelection channels;
+    uint32_t decimateTo = 0;
+    ToneDetection detection = ToneDetection::Envelope;
+    std::vector<double> carriers;
+    size_t findCarriers = 0;
+    bool adaptiveTiming = false;
+    TimingProfile timing;
+
+    bool carrierBank() const { return findCarriers > 1 || carriers.size() > 1; }
+};
+
 class MorseDecoder : public MorseBase {
     MorseConverter converter;
+    bool echoMorse;
+    unsigned threads;
+    DecoderSettings settings;
 public:
+    static constexpr size_t SAMPLES_PER_THREAD = 1024 * 1024;
+    // Decimating further would put the carrier too close to the filter cutoff.
+    static constexpr uint32_t MIN_WORKING_RATE = WavProcessor<>::MIN_SAMPLE_RATE;
+
+    explicit MorseDecoder(bool echo = true, unsigned threadCount = std::thread::hardware_concurrency(),
+                          DecoderSettings decoderSettings = {})
+        : echoMorse(echo), threads(std::max(1u, threadCount)), settings(decoderSettings) {
+        if (settings.decimateTo != 0 && settings.decimateTo < MIN_WORKING_RATE) {
+            throw MorseException("Working rate must be at least " + std::to_string(MIN_WORKING_RATE) + " Hz");
+        }
+        settings.timing.validate();
+    }
+
     std::string encode(const std::string&) override { throw MorseException("Decoder cannot encode"); }
     std::string decode(const std::string& morse) override { return converter.decode(morse); }
 
+    // Decodes block by block, writing characters out as soon as they complete. The
+    // sample format comes from the file's fmt chunk unless the settings name one.
+    // Where mmap is available the blocks point straight into the mapped file.
     void decodeFile(const std::string& input, const std::string& output) {
-        const auto morse = WavProcessor<>::loadWav(input);
-        const auto text = decode(morse);
-        FileHandler::write(output, text);
+        withSampleType(settings.format ? *settings.format : probeFormat(input), [&](auto tag) {
+            using SampleType = decltype(tag);
+#ifdef MORSE_HAS_MMAP
+            const MappedWav<SampleType> source(input);
+#else
+            WavReader<SampleType> source(input);
+#endif
+            decodeSource<SampleType>(source, output);
+        });
+    }
+
+private:
+    // One mono signal the detectors listen to: a channel, the mix of all
+    // channels (channel < 0), or the file itself. It is extracted and decimated
+    // once per block however many carriers are decoded from it.
+    template<typename SampleType>
+    struct Input {
+        int channel;
+        Decimator<SampleType> decimator;
+        std::vector<SampleType> mono;
+        std::vector<SampleType> decimated;
+        const SampleType* samples = nullptr;
+        size_t count = 0;
+
+        Input(int source, uint32_t sampleRate, uint32_t decimateTo) : channel(source), decimator(sampleRate, decimateTo) {}
+    };
+
+    // Per-output decoding state: one per channel in "all" mode, times one per
+    // carrier of a carrier bank.
+    template<typename SampleType>
+    struct Stream {
+        size_t input;
+        std::string label;
+        typename WavProcessor<SampleType>::Detector detector;
+        MorseConverter::DecodeState state;
+        std::ofstream out;
+        std::string morse;
+        std::string echoed;
+        std::vector<char> text;
+
+        Stream(size_t source, std::string name, uint32_t workingRate, const DecoderSettings& settings,
+               ToneDetection detection, double carrier, const std::string& filename)
+            : input(source), label(std::move(name)),
+              detector(workingRate, detection, carrier, settings.adaptiveTiming, settings.timing), out(filename) {
+            if (carrier > CarrierSearch::MAX_FRACTION * workingRate) {
+                throw MorseException("Carrier " + std::to_string(std::lround(carrier)) + " Hz is too high for a " +
+                                     std::to_string(workingRate) + " Hz working rate");
+            }
+            if (!out) throw MorseException("Cannot write " + filename);
+        }
+    };
+
+    // Averages the spectrum of segments spread evenly over the file, on one
+    // channel or (channel < 0) the mix of all of them.
+    template<typename SampleType, typename Source>
+    static std::vector<double> findCarriers(Source& reader, int channel, size_t maxCount) {
+        const unsigned channels = reader.channels();
+        CarrierSearch search(reader.sampleRate());
+        const size_t length = search.segmentLength();
+        const uint64_t frames = reader.sampleCount() / channels;
+        const size_t count = static_cast<size_t>(std::clamp<uint64_t>(frames / length, 1, CarrierSearch::SEGMENTS));
+
+        std::vector<SampleType> raw(length * channels), mono(length);
+        std::vector<float> segment(length);
+        for (size_t s = 0; s < count; ++s) {
+            const uint64_t start = count > 1 ? (frames - length) * s / (count - 1) : 0;
+            const size_t got = reader.readAt(start * channels, length * channels, raw.data()) / channels;
+            const SampleType* data = raw.data();
+            if (channels > 1) {
+                if (channel < 0) {
+                    ChannelMixer<SampleType>::mixdown(raw.data(), got, channels, mono.data());
+                } else {
+                    ChannelMixer<SampleType>::extract(raw.data(), got, channels, static_cast<unsigned>(channel), mono.data());
+                }
+                data = mono.data();
+            }
+            for (size_t i = 0; i < length; ++i) {
+                segment[i] = i < got ? static_cast<float>(SampleTraits<SampleType>::value(data[i])) : 0.0f;
+            }
+            search.add(segment.data());
+        }
+        return search.carriers(maxCount);
+    }
+
+    // "out.txt" becomes "out.ch0.txt", "out.612Hz.txt" or "out.ch0.612Hz.txt".
+    static std::string streamOutput(const std::string& output, const std::string& suffix) {
+        if (suffix.empty()) return output;
+        std::filesystem::path path(output);
+        return path.replace_filename(path.stem().string() + suffix + path.extension().string()).string();
+    }
+
+    template<typename SampleType, typename Source>
+    void decodeSource(Source& reader, const std::string& output) {
+        const ChannelSelection& selection = settings.channels;
+        const unsigned channels = reader.channels();
+        if (selection.mode == ChannelSelection::Mode::Single && selection.channel >= channels) {
+            throw MorseException("Channel " + std::to_string(selection.channel) + " out of range; the file has " +
+                                 std::to_string(channels) + " channel(s)");
+        }
+        const bool all = selection.mode == ChannelSelection::Mode::All && channels > 1;
+        const bool bank = settings.carrierBank();
+        const ToneDetection detection = settings.findCarriers || !settings.carriers.empty() ? ToneDetection::Goertzel
+                                                                                             : settings.detection;
+
+        std::vector<Input<SampleType>> inputs;
+        if (all) {
+            for (unsigned c = 0; c < channels; ++c) inputs.emplace_back(static_cast<int>(c), reader.sampleRate(), settings.decimateTo);
+        } else {
+            const int channel = channels == 1 ? 0 : selection.mode == ChannelSelection::Mode::Mix ? -1 : static_cast<int>(selection.channel);
+            inputs.emplace_back(channel, reader.sampleRate(), settings.decimateTo);
+        }
+
+        std::vector<Stream<SampleType>> streams;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            const std::string channelName = all ? "Channel " + std::to_string(inputs[i].channel) : "";
+            std::vector<double> carriers = settings.carriers;
+            if (settings.findCarriers) {
+                carriers = findCarriers<SampleType>(reader, inputs[i].channel, settings.findCarriers);
+                if (echoMorse) {
+                    std::cout << (all ? channelName + " " : "");
+                    if (carriers.empty()) {
+                        std::cout << "No carrier found; listening at the default frequency" << std::endl;
+                    } else {
+                        std::cout << "Carrier" << (carriers.size() > 1 ? "s:" : ":");
+                        for (const double carrier : carriers) std::cout << " " << std::lround(carrier) << " Hz";
+                        std::cout << std::endl;
+                    }
+                }
+            }
+            if (carriers.empty()) carriers.push_back(0.0);
+
+            const uint32_t workingRate = inputs[i].decimator.outputRate(reader.sampleRate());
+            for (const double carrier : carriers) {
+                const long hz = std::lround(carrier > 0.0 ? carrier : WavProcessor<SampleType>::DEFAULT_CARRIER);
+                std::string suffix = all ? ".ch" + std::to_string(inputs[i].channel) : "";
+                std::string label = channelName;
+                if (bank) {
+                    suffix += "." + std::to_string(hz) + "Hz";
+                    label += (label.empty() ? "" : " ") + std::to_string(hz) + " Hz";
+                }
+                streams.emplace_back(i, label, workingRate, settings, detection, carrier, streamOutput(output, suffix));
+            }
+        }
+
+        // Threads go to streams first; any left over split each stream's block.
+        const bool single = streams.size() == 1;
+        const unsigned streamThreads = std::max(1u, threads / static_cast<unsigned>(streams.size()));
+        const auto decodeStream = [&](size_t k, bool flush) {
+            auto& stream = streams[k];
+            const auto& input = inputs[stream.input];
+            stream.morse.clear();
+            if (flush) {
+                stream.detector.finish(stream.morse);
+            } else {
+                stream.detector.feed(input.samples, input.count, stream.morse, streamThreads);
+            }
+            stream.text.resize(std::max(stream.text.size(), stream.morse.size()));
+            stream.out.write(stream.text.data(), static_cast<std::streamsize>(converter.decodeChunk(stream.morse, stream.state, stream.text.data())));
+            if (echoMorse && !single) stream.echoed += stream.morse;
+        };
+
+        if (echoMorse && single) std::cout << "Decoded Morse: ";
+        const size_t frames = threads > 1 ? threads * SAMPLES_PER_THREAD : WavReader<SampleType>::BLOCK_SIZE;
+        reader.forEachBlock([&](const SampleType* samples, size_t n) {
+            const size_t count = n / channels;
+            for (auto& input : inputs) {
+                input.samples = samples;
+                input.count = count;
+                if (channels > 1) {
+                    input.mono.resize(count);
+                    if (input.channel < 0) {
+                        ChannelMixer<SampleType>::mixdown(samples, count, channels, input.mono.data());
+                    } else {
+                        ChannelMixer<SampleType>::extract(samples, count, channels, static_cast<unsigned>(input.channel), input.mono.data());
+                    }
+                    input.samples = input.mono.data();
+                }
+                if (input.decimator.active()) {
+                    input.decimator.process(input.samples, input.count, input.decimated, threads);
+                    input.samples = input.decimated.data();
+                    input.count = input.decimated.size();
+                }
+            }
+            if (threads == 1 || single) {
+                for (size_t k = 0; k < streams.size(); ++k) decodeStream(k, false);
+            } else {
+                std::vector<std::thread> workers;
+                for (size_t k = 0; k < streams.size(); ++k) workers.emplace_back(decodeStream, k, false);
+                for (auto& worker : workers) worker.join();
+            }
+            if (echoMorse && single) std::cout << streams[0].morse;
+        }, frames * channels);
+
+        for (size_t k = 0; k < streams.size(); ++k) decodeStream(k, true);
+        if (echoMorse && single) std::cout << streams[0].morse;
+        for (auto& stream : streams) {
+            char last;
+            stream.out.write(&last, static_cast<std::streamsize>(converter.finishDecode(stream.state, &last)));
+        }
+        if (echoMorse && single) std::cout << std::endl;
+        for (size_t k = 0; echoMorse && !single && k < streams.size(); ++k) {
+            std::cout << streams[k].label << " Morse: " << streams[k].echoed << std::endl;
+        }
+    }
+};
+
+enum class BatchMode { Encode, Decode };
+
+struct BatchJob {
+    BatchMode mode;
+    std::string input;
+    std::string output;
+};
+
+// Runs many encode/decode jobs in one process. Workers pull jobs from a shared
+// index; converter tables are constexpr and waveform caches are process-wide, so
+// every job after the first reuses them.
+class BatchRunner {
+    struct Result {
+        bool ok = false;
+        std::string error;
+        uint64_t inputBytes = 0;
+        double seconds = 0.0;
+    };
+
+    static Result runJob(const BatchJob& job) {
+        Result result;
+        const auto start = std::chrono::steady_clock::now();
+        try {
+            if (job.mode == BatchMode::Encode) {
+                MorseEncoder(1).encodeFile(job.input, job.output);
+            } else {
+                MorseDecoder(false, 1).decodeFile(job.input, job.output);
+            }
+            result.inputBytes = std::filesystem::file_size(job.input);
+            result.ok = true;
+        } catch (const std::exception& e) {
+            result.error = e.what();
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+public:
+    // Manifest lines are "encode <input> <output>" or "decode <input> <output>";
+    // blank lines and lines starting with '#' are ignored. Jobs run concurrently, so
+    // no job may read another job's output.
+    static std::vector<BatchJob> loadManifest(const std::string& filename) {
+        std::ifstream file(filename);
+        if (!file) throw MorseException("Cannot read " + filename);
+
+        std::vector<BatchJob> jobs;
+        std::string line;
+        for (size_t lineNo = 1; std::getline(file, line); ++lineNo) {
+            std::istringstream fields(line);
+            std::string mode, input, output;
+            if (!(fields >> mode) || mode[0] == '#') continue;
+            if (!(fields >> input >> output) || (mode != "encode" && mode != "decode")) {
+                throw MorseException(filename + ":" + std::to_string(lineNo) + ": expected 'encode|decode <input> <output>'");
+            }
+            jobs.push_back({mode == "encode" ? BatchMode::Encode : BatchMode::Decode, input, output});
+        }
+        return jobs;
+    }
+
+    // One job per .txt (encode) or .wav (decode) file in inputDir, written to outputDir.
+    static std::vector<BatchJob> scanDirectory(BatchMode mode, const std::string& inputDir, const std::string& outputDir) {
+        namespace fs = std::filesystem;
+        if (!fs::is_directory(inputDir)) throw MorseException("Not a directory: " + inputDir);
+        fs::create_directories(outputDir);
+
+        const std::string from = (mode == BatchMode::Encode) ? ".txt" : ".wav";
+        const std::string to = (mode == BatchMode::Encode) ? ".wav" : ".txt";
+        std::vector<BatchJob> jobs;
+        for (const auto& entry : fs::directory_iterator(inputDir)) {
+            if (!entry.is_regular_file() || entry.path().extension() != from) continue;
+            const fs::path output = fs::path(outputDir) / entry.path().stem().concat(to);
+            jobs.push_back({mode, entry.path().string(), output.string()});
+        }
+        std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.input < b.input; });
+        return jobs;
+    }
+
+    // Returns true when every job succeeded.
+    static bool run(const std::vector<BatchJob>& jobs, unsigned threads = std::thread::hardware_concurrency()) {
+        threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(jobs.size())));
+        std::vector<Result> results(jobs.size());
+        std::atomic<size_t> next{0};
+        std::mutex outputMutex;
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                for (size_t i = next++; i < jobs.size(); i = next++) {
+                    results[i] = runJob(jobs[i]);
+                    std::lock_guard<std::mutex> lock(outputMutex);
+                    std::cout << (results[i].ok ? "[OK]     " : "[FAILED] ") << jobs[i].input << " -> " << jobs[i].output;
+                    if (results[i].ok) {
+                        std::cout << " (" << results[i].seconds << " s)\n";
+                    } else {
+                        std::cout << ": " << results[i].error << "\n";
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t succeeded = 0;
+        uint64_t bytes = 0;
+        for (const auto& result : results) {
+            succeeded += result.ok;
+            bytes += result.inputBytes;
+        }
+        std::cout << succeeded << "/" << jobs.size() << " files succeeded on " << threads << " thread(s) in "
+                  << elapsed << " s (" << (elapsed > 0 ? bytes / elapsed / 1e6 : 0.0) << " MB/s input, "
+                  << (elapsed > 0 ? jobs.size() / elapsed : 0.0) << " files/s)" << std::endl;
+        return succeeded == jobs.size();
+    }
+};
+
+// Optional "--name value" pairs after the positional arguments.
+struct CliOptions {
+    // Upper bound for --carriers auto.
+    static constexpr size_t MAX_CARRIERS = 8;
+
+    SampleFormat format = SampleFormat::U8;
+    uint32_t sampleRate = WavProcessor<>::SAMPLE_RATE;
+    TimingProfile timing;
+    DecoderSettings decoding;
+
+    static CliOptions parse(int argc, char* argv[], int first) {
+        CliOptions options;
+        for (int i = first; i < argc; i += 2) {
+            const std::string name(argv[i]);
+            if (i + 1 >= argc) throw MorseException("Missing value for " + name);
+            const std::string value(argv[i + 1]);
+            if (name == "--format") {
+                options.format = parseSampleFormat(value);
+                options.decoding.format = options.format;
+            } else if (name == "--channel") {
+                options.decoding.channels = ChannelSelection::parse(value);
+            } else if (name == "--rate") {
+                options.sampleRate = parseRate(value);
+            } else if (name == "--decimate") {
+                options.decoding.decimateTo = parseRate(value);
+            } else if (name == "--detector") {
+                if (value != "envelope" && value != "goertzel") {
+                    throw MorseException("Unknown detector '" + value + "' (use envelope or goertzel)");
+                }
+                options.decoding.detection = value == "goertzel" ? ToneDetection::Goertzel : ToneDetection::Envelope;
+            } else if (name == "--carrier") {
+                options.decoding.findCarriers = value == "auto" ? 1 : 0;
+                options.decoding.carriers.clear();
+                if (value != "auto") options.decoding.carriers.push_back(parseFrequency(value));
+            } else if (name == "--wpm") {
+                options.timing.wpm = parseNumber(value, "speed");
+            } else if (name == "--farnsworth") {
+                options.timing.farnsworthWpm = parseNumber(value, "speed");
+            } else if (name == "--ramp") {
+                options.timing.rampMs = parseNumber(value, "ramp", true);
+            } else if (name == "--timing") {
+                if (value != "fixed" && value != "adaptive") {
+                    throw MorseException("Unknown timing '" + value + "' (use fixed or adaptive)");
+                }
+                options.decoding.adaptiveTiming = value == "adaptive";
+            } else if (name == "--carriers") {
+                options.decoding.findCarriers = value == "auto" ? MAX_CARRIERS : 0;
+                options.decoding.carriers.clear();
+                for (size_t start = 0; value != "auto" && start <= value.size();) {
+                    const size_t comma = std::min(value.find(',', start), value.size());
+                    options.decoding.carriers.push_back(parseFrequency(value.substr(start, comma - start)));
+                    start = comma + 1;
+                }
+            } else {
+                throw MorseException("Unknown option " + name);
+            }
+        }
+        options.decoding.timing = options.timing;
+        return options;
+    }
+
+private:
+    // A positive (or, with allowZero, non-negative) decimal number; what names it
+    // in the error message.
+    static double parseNumber(const std::string& value, const std::string& what, bool allowZero = false) {
+        size_t end = 0;
+        double number = 0.0;
+        try {
+            number = std::stod(value, &end);
+        } catch (const std::exception&) {
+            end = 0;
+        }
+        if (end == 0 || end != value.size() || !(number > 0.0 || (allowZero && number == 0.0))) throw MorseException("Invalid " + what + " '" + value + "'");
+        return number;
+    }
+
+    static double parseFrequency(const std::string& value) { return parseNumber(value, "frequency"); }
+
+    static uint32_t parseRate(const std::string& value) {
+        if (value.empty() || value.size() > 9 || !std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            throw MorseException("Invalid sample rate '" + value + "'");
+        }
+        return static_cast<uint32_t>(std::stoul(value));
     }
 };
 
 int main(int argc, char* argv[]) {
     try {
-        if (argc == 4) {
+        if (argc == 3 && std::string(argv[1]) == "--batch") {
+            return BatchRunner::run(BatchRunner::loadManifest(argv[2])) ? 0 : 1;
+        }
+        if (argc == 4 && (std::string(argv[1]) == "--batch-encode" || std::string(argv[1]) == "--batch-decode")) {
+            const BatchMode mode = std::string(argv[1]) == "--batch-encode" ? BatchMode::Encode : BatchMode::Decode;
+            return BatchRunner::run(BatchRunner::scanDirectory(mode, argv[2], argv[3])) ? 0 : 1;
+        }
+        if (argc >= 4) {
             const std::string mode(argv[1]);
             const std::string input(argv[2]);
             const std::string output(argv[3]);
+            const CliOptions options = CliOptions::parse(argc, argv, 4);
 
             if (mode == "--encode") {
-                MorseEncoder().encodeFile(input, output);
+                MorseEncoder(std::thread::hardware_concurrency(), options.format, options.sampleRate, options.timing)
+                    .encodeFile(input, output);
                 std::cout << "Encoded successfully to " << output << std::endl;
             }
             else if (mode == "--decode") {
-                MorseDecoder().decodeFile(input, output);
+                MorseDecoder(true, std::thread::hardware_concurrency(), options.decoding).decodeFile(input, output);
                 std::cout << "Decoded successfully to " << output << std::endl;
             }
             else {
@@ -326,6 +2658,12 @@ int main(int argc, char* argv[]) {
         const std::string test_file = "test.txt";
         const std::string test_wav = "test.wav";
         const std::string test_out = "output.txt";
+        std::string dense_message = "PARIS";
+        for (int i = 1; i < 12; ++i) dense_message += " PARIS";
+        const std::string dense_file = "dense.txt";
+        const std::string dense_wav = "dense.wav";
+        const std::string dense_single = "dense.1thread.txt";
+        const std::string dense_parallel = "dense.nthreads.txt";
 
         FileHandler::write(test_file, test_message);
 
@@ -337,8 +2675,27 @@ int main(int argc, char* argv[]) {
         MorseDecoder().decodeFile(test_wav, test_out);
 
         const std::string decoded = FileHandler::read(test_out);
-        std::cout << "Original message: " << test_message << "\nDecoded message: " << decoded << "\n"
-                  << (test_message == decoded ? "SUCCESS" : "FAILURE") << std::endl;
+        std::cout << "Original message: " << test_message << "\nDecoded message: " << decoded << "\n";
+
+        // The text must not depend on how many threads share the decode, and so
+        // on the block sizes the detector is fed. Fast keying that starts at once
+        // is the hard case for the Goertzel detector's noise seeding. Twelve words
+        // at 30 WPM are about a million samples, enough for three threads to
+        // split the Goertzel measurement instead of falling back to one.
+        TimingProfile fast;
+        fast.wpm = 30;
+        DecoderSettings goertzel;
+        goertzel.detection = ToneDetection::Goertzel;
+        goertzel.timing = fast;
+        const unsigned threads = 3;
+        FileHandler::write(dense_file, dense_message);
+        MorseEncoder(1, SampleFormat::U8, WavProcessor<>::SAMPLE_RATE, fast).encodeFile(dense_file, dense_wav);
+        MorseDecoder(false, 1, goertzel).decodeFile(dense_wav, dense_single);
+        MorseDecoder(false, threads, goertzel).decodeFile(dense_wav, dense_parallel);
+        const std::string single = FileHandler::read(dense_single);
+        const bool threadsAgree = single == dense_message && single == FileHandler::read(dense_parallel);
+        std::cout << "Goertzel decode on 1 and " << threads << " threads: " << (threadsAgree ? "identical" : "DIFFERENT") << "\n"
+                  << (test_message == decoded && threadsAgree ? "SUCCESS" : "FAILURE") << std::endl;
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;